@@ -3,7 +3,17 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "center_impl.h"
+#include "count_kernels.h"
+#include "weighted_impl.h"
+#include "scratch_arena.h"
+#include "radix_sort.h"
+#include "native_input.h"
+#include "sweep_select.h"
+#include "kernel_stats.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -12,292 +22,802 @@ static inline double midpoint_fc(double a, double b) {
     return 0.5 * a + 0.5 * b;
 }
 
-static int cmp_double_fc(const void *a, const void *b) {
-    double da = *(const double *)a;
-    double db = *(const double *)b;
-    if (da < db) return -1;
-    if (da > db) return 1;
+static int cmp_rank_fc(const void *a, const void *b) {
+    long long ra = *(const long long *)a;
+    long long rb = *(const long long *)b;
+    if (ra < rb) return -1;
+    if (ra > rb) return 1;
     return 0;
 }
 
 /*
- * Core computation: Center (Hodges-Lehmann) estimator.
- * Uses Monahan's Algorithm 616 with deterministic pivot selection.
- * Allocates and frees its own working memory.
+ * State shared by every rank group of one selection: the sorted input, the
+ * per-row partition counts and per-chunk active set sizes (consumed right
+ * after each sweep, so one set of arrays serves all groups), the bounds
+ * copies of diverged groups (one pair per nesting level), the global
+ * iteration budget, the number of row blocks every pass is split into, the
+ * work counters and the time budget (each NULL when not used).
+ * Row and column indices and per-row counts are below n and stay 32-bit;
+ * only sizes summed over rows need 64 bits.
  */
-double center_impl_compute(const double *values, int n, int assume_sorted) {
-    if (n == 1) return values[0];
-    if (n == 2) return midpoint_fc(values[0], values[1]);
+typedef struct {
+    const double *sorted_values;
+    int n;
+    int *below_counts;
+    int *at_or_below_counts;
+    long long *chunk_below_sizes;
+    long long *chunk_above_sizes;
+    int *copies;
+    long long iterations_left;
+    int blocks;
+    KernelStats *stats;
+    KernelBudget *budget;
+} CenterSelection;
 
-    /* Use input directly when sorted; otherwise sort a copy */
-    double *sorted_values;
-    int allocated_sorted = 0;
-    if (assume_sorted) {
-        sorted_values = (double *)values;
-    } else {
-        sorted_values = (double *)malloc(n * sizeof(double));
-        if (!sorted_values) {
-            error("center_impl: memory allocation failed");
-        }
-        memcpy(sorted_values, values, n * sizeof(double));
-        qsort(sorted_values, n, sizeof(double), cmp_double_fc);
-        allocated_sorted = 1;
+/*
+ * Bound update decided by the last target check but not yet written: the
+ * next sweep applies it row by row before partitioning that row, so narrowing
+ * the active set costs no pass of its own.
+ */
+typedef enum {
+    CENTER_KEEP_ALL,
+    CENTER_KEEP_BELOW,
+    CENTER_KEEP_ABOVE
+} CenterKeep;
+
+/* Totals of one sweep over a range of rows */
+typedef struct {
+    long long count_below;
+    long long count_at_or_below;
+    long long size_below;  // active set size if the averages below the pivot are kept
+    long long size_above;  // active set size if the averages above the pivot are kept
+} CenterSweep;
+
+/*
+ * Intra-call parallelism: with blocks > 1 every O(n) pass over the rows is cut
+ * into `blocks` contiguous row ranges, one per OpenMP thread. A block starts
+ * its two-pointer sweep at the column the serial sweep would reach there
+ * (located by binary search) and yields integer counts, which sum the same in
+ * any order, so on sorted input the selection takes exactly the serial path
+ * and the result does not depend on the thread count. Blocks start on chunk
+ * boundaries, so every chunk size is written by a single thread.
+ */
+
+/* Number of row blocks for `threads` workers: serial below 2^15 rows per block */
+static int center_blocks(int n, int threads) {
+    int blocks = MIN(threads, CENTER_MAX_THREADS);
+    blocks = MIN(blocks, n >> 15);
+    return MAX(blocks, 1);
+}
+
+/* Number of CENTER_CHUNK_ROWS-row chunks covering n rows */
+static inline size_t center_chunks(int n) {
+    return ((size_t)n + CENTER_CHUNK_ROWS - 1) / CENTER_CHUNK_ROWS;
+}
+
+static inline int center_block_begin(int n, int blocks, int block) {
+    if (block >= blocks) return n;
+    int row = (int)((long long)n * block / blocks);
+    return row - row % CENTER_CHUNK_ROWS;
+}
+
+/* Right bound of `row` once only the averages below the pivot are kept */
+static inline int center_right_below(const CenterSelection *sel, int right, int row) {
+    return MIN(right, row + sel->below_counts[row] - 1);
+}
+
+/* Left bound of `row` once only the averages above the pivot are kept */
+static inline int center_left_above(const CenterSelection *sel, int left, int row) {
+    return MAX(left, row + sel->at_or_below_counts[row]);
+}
+
+/* Number of active averages in rows [row_begin, row_end) */
+static long long center_active_rows(const int *left_bounds, const int *right_bounds,
+                                    int row_begin, int row_end) {
+    long long size = 0;
+    for (int i = row_begin; i < row_end; i++) {
+        size += MAX(0, right_bounds[i] - left_bounds[i] + 1);
     }
+    return size;
+}
 
-    /* Calculate target median rank(s) */
-    long long total_pairs = ((long long)n * (n + 1)) / 2;
-    long long median_rank_low = (total_pairs + 1) / 2;
-    long long median_rank_high = (total_pairs + 2) / 2;
+/*
+ * Pick the next pivot from the active set: the middle column of the row holding
+ * the middle element. Returns the active set size. Needs a pass of its own, so
+ * it only serves the first pivot of a rank group; later pivots come from the
+ * sizes the sweep collects (center_chunk_pivot).
+ */
+static long long center_next_pivot(const CenterSelection *sel,
+                                   const int *left_bounds,
+                                   const int *right_bounds,
+                                   double *pivot) {
+    int n = sel->n;
+    int blocks = sel->blocks;
+    long long block_sizes[CENTER_MAX_THREADS];
+
+    if (blocks > 1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(blocks) schedule(static, 1)
+#endif
+        for (int block = 0; block < blocks; block++) {
+            block_sizes[block] = center_active_rows(left_bounds, right_bounds, center_block_begin(n, blocks, block),
+                                                    center_block_begin(n, blocks, block + 1));
+        }
+    } else {
+        block_sizes[0] = center_active_rows(left_bounds, right_bounds, 0, n);
+    }
 
-    /* Initialize search bounds */
-    long long *left_bounds = (long long *)malloc(n * sizeof(long long));
-    if (!left_bounds) {
-        if (allocated_sorted) free(sorted_values);
-        error("center_impl: memory allocation failed");
+    long long active_set_size = 0;
+    for (int block = 0; block < blocks; block++) {
+        active_set_size += block_sizes[block];
     }
-    long long *right_bounds = (long long *)malloc(n * sizeof(long long));
-    if (!right_bounds) {
-        if (allocated_sorted) free(sorted_values);
-        free(left_bounds);
-        error("center_impl: memory allocation failed");
+    if (active_set_size == 0) return 0;
+
+    /* Skip whole blocks before the one holding the middle element */
+    long long target_index = active_set_size / 2;
+    long long cumulative_size = 0;
+    int first_row = 0;
+    for (int block = 0; block < blocks; block++) {
+        if (target_index < cumulative_size + block_sizes[block]) {
+            first_row = center_block_begin(n, blocks, block);
+            break;
+        }
+        cumulative_size += block_sizes[block];
     }
-    long long *partition_counts = (long long *)malloc(n * sizeof(long long));
-    if (!partition_counts) {
-        if (allocated_sorted) free(sorted_values);
-        free(left_bounds);
-        free(right_bounds);
-        error("center_impl: memory allocation failed");
+
+    int selected_row = 0;
+    for (int i = first_row; i < n; i++) {
+        int row_size = MAX(0, right_bounds[i] - left_bounds[i] + 1);
+        if (target_index < cumulative_size + row_size) {
+            selected_row = i;
+            break;
+        }
+        cumulative_size += row_size;
     }
 
-    for (int i = 0; i < n; i++) {
-        left_bounds[i] = i;
-        right_bounds[i] = n - 1;
+    int median_column_in_row = (int)(((long long)left_bounds[selected_row] + right_bounds[selected_row]) / 2);
+    *pivot = midpoint_fc(sel->sorted_values[selected_row], sel->sorted_values[median_column_in_row]);
+    return active_set_size;
+}
+
+/*
+ * Next pivot after the last sweep, had `keep` been applied to the bounds:
+ * whole chunks are skipped by their recorded sizes, and only the chunk holding
+ * the middle element is walked, narrowing its bounds on the fly. Same pivot as
+ * center_next_pivot on the updated bounds, without touching the other rows.
+ */
+static double center_chunk_pivot(const CenterSelection *sel,
+                                 const int *left_bounds, const int *right_bounds,
+                                 CenterKeep keep, long long active_set_size) {
+    const long long *chunk_sizes = keep == CENTER_KEEP_BELOW ? sel->chunk_below_sizes : sel->chunk_above_sizes;
+    int n = sel->n;
+    long long target_index = active_set_size / 2;
+    long long cumulative_size = 0;
+    int chunk = 0;
+    while (target_index >= cumulative_size + chunk_sizes[chunk]) {
+        cumulative_size += chunk_sizes[chunk++];
     }
 
-    double pivot = sorted_values[(n - 1) / 2] + sorted_values[n / 2];
-    long long active_set_size = total_pairs;
-    long long previous_count = 0;
+    int row = chunk * CENTER_CHUNK_ROWS;
+    int row_end = MIN(row + CENTER_CHUNK_ROWS, n);
+    int left = 0;
+    int right = -1;
+    for (; row < row_end; row++) {
+        left = left_bounds[row];
+        right = right_bounds[row];
+        if (keep == CENTER_KEEP_BELOW) right = center_right_below(sel, right, row);
+        else left = center_left_above(sel, left, row);
+        int row_size = MAX(0, right - left + 1);
+        if (target_index < cumulative_size + row_size) break;
+        cumulative_size += row_size;
+    }
 
-    double result = 0.0;
+    int median_column_in_row = (int)(((long long)left + right) / 2);
+    return midpoint_fc(sel->sorted_values[row], sel->sorted_values[median_column_in_row]);
+}
 
-    /*
-     * Bound the selection loop. On valid sorted input the Monahan selection
-     * converges in O(log n) iterations; this cap is far higher than ever
-     * needed for sorted input but guarantees termination on misuse (e.g.,
-     * assume_sorted=TRUE on UNSORTED input, which is undefined behavior and
-     * would otherwise wedge the process in an unkillable infinite loop inside
-     * the C extension). The cap scales with n so large valid inputs are never
-     * starved, and it counts EVERY pass through the loop, so it also
-     * terminates the convergence-check ping-pong mode. We additionally track
-     * no-progress (stall) on the active set to bail out deterministically.
-     */
-    const int base_iterations = 256;
-    const int max_iterations = base_iterations + 4 * n;
-    long long previous_active_set_size = -1;
-    int stall_count = 0;
-    const int max_stall = 8;
+/* Keep only the averages strictly below the last pivot */
+static void center_keep_below(const CenterSelection *sel, int *right_bounds) {
+    int n = sel->n;
+    if (sel->blocks > 1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(sel->blocks) schedule(static)
+#endif
+        for (int i = 0; i < n; i++) {
+            right_bounds[i] = center_right_below(sel, right_bounds[i], i);
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        right_bounds[i] = center_right_below(sel, right_bounds[i], i);
+    }
+}
 
-    for (int iter = 0; iter < max_iterations; iter++) {
-        /* === PARTITION STEP === */
-        long long count_below_pivot = 0;
-        long long current_column = n - 1;
+/* Keep only the averages strictly above the last pivot */
+static void center_keep_above(const CenterSelection *sel, int *left_bounds) {
+    int n = sel->n;
+    if (sel->blocks > 1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(sel->blocks) schedule(static)
+#endif
+        for (int i = 0; i < n; i++) {
+            left_bounds[i] = center_left_above(sel, left_bounds[i], i);
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        left_bounds[i] = center_left_above(sel, left_bounds[i], i);
+    }
+}
 
-        for (int row = 0; row < n; row++) {
-            partition_counts[row] = 0;
+/*
+ * Largest column c in [row, n) whose average with `row` is below the pivot
+ * (strictly when `inclusive` is 0), or row - 1: where the serial sweep's
+ * column pointer stands at `row`, found by binary search so a row block can
+ * start its sweep on its own.
+ */
+static int center_start_column(const CenterSelection *sel, int row, double pivot, int inclusive) {
+    const double *sorted_values = sel->sorted_values;
+    int lo = row - 1;
+    int hi = sel->n - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        double average = midpoint_fc(sorted_values[row], sorted_values[mid]);
+        if (inclusive ? average <= pivot : average < pivot) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
 
-            while (current_column >= row &&
-                   sorted_values[row] + sorted_values[current_column] >= pivot) {
-                current_column--;
-            }
+/*
+ * One fused sweep over rows [row_begin, row_end) (row_begin on a chunk
+ * boundary): applies the pending `keep` to each row's bounds, partitions the
+ * row around the pivot with the two-pointer scan, and records per chunk the
+ * active set sizes both possible next decisions would leave. Adds the totals
+ * to `sweep`.
+ */
+static void center_sweep_rows(CenterSelection *sel, int *left_bounds, int *right_bounds,
+                              CenterKeep keep, double pivot, int row_begin, int row_end,
+                              CenterSweep *sweep) {
+    const double *sorted_values = sel->sorted_values;
+    int n = sel->n;
+    int column_below = n - 1;
+    int column_at_or_below = n - 1;
+    if (row_begin > 0) {
+        column_below = center_start_column(sel, row_begin, pivot, 0);
+        column_at_or_below = center_start_column(sel, row_begin, pivot, 1);
+    }
 
-            if (current_column >= row) {
-                long long elements_below = current_column - row + 1;
-                partition_counts[row] = elements_below;
-                count_below_pivot += elements_below;
+    CenterSweep totals = { 0, 0, 0, 0 };
+    for (int chunk_begin = row_begin; chunk_begin < row_end; chunk_begin += CENTER_CHUNK_ROWS) {
+        int chunk_end = MIN(chunk_begin + CENTER_CHUNK_ROWS, row_end);
+        long long chunk_below = 0;
+        long long chunk_above = 0;
+        for (int row = chunk_begin; row < chunk_end; row++) {
+            int left = left_bounds[row];
+            int right = right_bounds[row];
+            if (keep == CENTER_KEEP_BELOW) {
+                right = right_bounds[row] = center_right_below(sel, right, row);
+            } else if (keep == CENTER_KEEP_ABOVE) {
+                left = left_bounds[row] = center_left_above(sel, left, row);
             }
-        }
-
-        /* === CONVERGENCE CHECK === */
-        if (count_below_pivot == previous_count) {
-            double min_active_sum = INFINITY;
-            double max_active_sum = -INFINITY;
 
-            for (int i = 0; i < n; i++) {
-                if (left_bounds[i] > right_bounds[i]) continue;
+            // Walk the columns down while midpoint_fc(row value, column) is
+            // at or above (resp. above) the pivot
+            double row_value = sorted_values[row];
+            column_below = count_retreat_mid_ge(sorted_values, column_below, row, row_value, pivot);
+            column_at_or_below = count_retreat_mid_gt(sorted_values, column_at_or_below, row,
+                                                      row_value, pivot);
+
+            int below = MAX(0, column_below - row + 1);
+            int at_or_below = MAX(0, column_at_or_below - row + 1);
+            sel->below_counts[row] = below;
+            sel->at_or_below_counts[row] = at_or_below;
+            totals.count_below += below;
+            totals.count_at_or_below += at_or_below;
+            chunk_below += MAX(0, MIN(right, row + below - 1) - left + 1);
+            chunk_above += MAX(0, right - MAX(left, row + at_or_below) + 1);
+        }
+        sel->chunk_below_sizes[chunk_begin / CENTER_CHUNK_ROWS] = chunk_below;
+        sel->chunk_above_sizes[chunk_begin / CENTER_CHUNK_ROWS] = chunk_above;
+        totals.size_below += chunk_below;
+        totals.size_above += chunk_above;
+    }
 
-                double row_value = sorted_values[i];
-                double smallest_in_row = sorted_values[left_bounds[i]] + row_value;
-                double largest_in_row = sorted_values[right_bounds[i]] + row_value;
+    sweep->count_below += totals.count_below;
+    sweep->count_at_or_below += totals.count_at_or_below;
+    sweep->size_below += totals.size_below;
+    sweep->size_above += totals.size_above;
+}
 
-                if (smallest_in_row < min_active_sum) min_active_sum = smallest_in_row;
-                if (largest_in_row > max_active_sum) max_active_sum = largest_in_row;
-            }
+/*
+ * Select the pairwise averages of rank ranks[0..n_ranks) (ascending, 1-based),
+ * all of which lie inside the active set described by left_bounds/right_bounds.
+ *
+ * Every pass partitions the active set around one pivot, counting averages
+ * strictly below and at-or-below it, so ties resolve exactly and every pass
+ * discards at least the pivot itself. All ranks share the partition passes
+ * while they fall on the same side of the pivot; once they diverge, the smaller
+ * group continues on a private copy of the bounds (recursively) and the larger
+ * one keeps narrowing in place, so at most log2(n_ranks) copies are live, one
+ * per nesting `depth`, all preallocated in the caller's scratch.
+ *
+ * While the ranks stay together a pass is a single sweep over the rows: it
+ * applies the previous decision to the bounds, partitions, and sizes both
+ * possible next active sets, so the next pivot is found without another pass.
+ */
+static int center_select_group(CenterSelection *sel,
+                               int *left_bounds, int *right_bounds,
+                               const long long *ranks, int n_ranks,
+                               double *out, double pivot, int depth) {
+    int n = sel->n;
+    int blocks = sel->blocks;
+    CenterKeep keep = CENTER_KEEP_ALL;
+    long long previous_active_set_size = -1;
+    int stall_count = 0;
+    const int max_stall = 8;
 
-            pivot = 0.5 * min_active_sum + 0.5 * max_active_sum;
-            if (pivot <= min_active_sum || pivot > max_active_sum) {
-                pivot = max_active_sum;
+    while (n_ranks > 0) {
+        if (sel->iterations_left-- <= 0) return CENTER_NO_CONVERGENCE;
+        int stop = kernel_budget_poll(sel->budget);
+        if (stop) return stop;
+        KERNEL_STATS_ADD(sel->stats, passes, 1);
+        KERNEL_STATS_ADD(sel->stats, sweeps, 1);
+
+        /* === PARTITION STEP (with the pending bound update) === */
+        CenterSweep sweep = { 0, 0, 0, 0 };
+        if (blocks > 1) {
+            CenterSweep block_sweeps[CENTER_MAX_THREADS];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(blocks) schedule(static, 1)
+#endif
+            for (int block = 0; block < blocks; block++) {
+                CenterSweep block_sweep = { 0, 0, 0, 0 };
+                center_sweep_rows(sel, left_bounds, right_bounds, keep, pivot,
+                                  center_block_begin(n, blocks, block),
+                                  center_block_begin(n, blocks, block + 1), &block_sweep);
+                block_sweeps[block] = block_sweep;
             }
-
-            if (min_active_sum == max_active_sum || active_set_size <= 2) {
-                result = pivot / 2.0;
-                goto cleanup;
+            for (int block = 0; block < blocks; block++) {
+                sweep.count_below += block_sweeps[block].count_below;
+                sweep.count_at_or_below += block_sweeps[block].count_at_or_below;
+                sweep.size_below += block_sweeps[block].size_below;
+                sweep.size_above += block_sweeps[block].size_above;
             }
+        } else {
+            center_sweep_rows(sel, left_bounds, right_bounds, keep, pivot, 0, n, &sweep);
+        }
 
-            continue;
+        /* === TARGET CHECK: split the ranks around the pivot === */
+        int below_end = 0;
+        while (below_end < n_ranks && ranks[below_end] <= sweep.count_below) below_end++;
+        int at_end = below_end;
+        while (at_end < n_ranks && ranks[at_end] <= sweep.count_at_or_below) {
+            out[at_end++] = pivot;
         }
 
-        /* === TARGET CHECK === */
-        int at_target_rank = (count_below_pivot == median_rank_low) ||
-                             (count_below_pivot == median_rank_high - 1);
-
-        if (at_target_rank) {
-            double largest_below_pivot = -INFINITY;
-            double smallest_at_or_above_pivot = INFINITY;
-
-            for (int i = 0; i < n; i++) {
-                long long count_in_row = partition_counts[i];
-                double row_value = sorted_values[i];
-                long long total_in_row = n - i;
-
-                if (count_in_row > 0) {
-                    long long last_below_index = i + count_in_row - 1;
-                    double last_below_value = row_value + sorted_values[last_below_index];
-                    if (last_below_value > largest_below_pivot)
-                        largest_below_pivot = last_below_value;
-                }
-
-                if (count_in_row < total_in_row) {
-                    long long first_at_or_above_index = i + count_in_row;
-                    double first_at_or_above_value = row_value + sorted_values[first_at_or_above_index];
-                    if (first_at_or_above_value < smallest_at_or_above_pivot)
-                        smallest_at_or_above_pivot = first_at_or_above_value;
-                }
+        int n_below = below_end;
+        int n_above = n_ranks - at_end;
+        if (n_below == 0 && n_above == 0) return CENTER_OK;
+
+        /* === NARROW THE ACTIVE SET AND PICK THE NEXT PIVOT === */
+        long long active_set_size;
+        if (n_below > 0 && n_above > 0) {
+            /* Divergence: hand the smaller group a private copy of the bounds */
+            int *copy_left = sel->copies + 2 * (size_t)n * depth;
+            int *copy_right = copy_left + n;
+            memcpy(copy_left, left_bounds, n * sizeof(int));
+            memcpy(copy_right, right_bounds, n * sizeof(int));
+
+            int below_is_smaller = n_below <= n_above;
+            if (below_is_smaller) {
+                center_keep_below(sel, copy_right);
+                center_keep_above(sel, left_bounds);
+            } else {
+                center_keep_above(sel, copy_left);
+                center_keep_below(sel, right_bounds);
             }
 
-            if (median_rank_low < median_rank_high) {
-                /* Even total: average the two middle values. Overflow-safe: quarter
-                 * each pair-sum before summing (both can be near the double max). */
-                result = 0.25 * smallest_at_or_above_pivot + 0.25 * largest_below_pivot;
-            } else {
-                int need_largest = (count_below_pivot == median_rank_low);
-                result = (need_largest ? largest_below_pivot : smallest_at_or_above_pivot) / 2.0;
+            double group_pivot = 0.0;
+            int status = CENTER_NO_CONVERGENCE;
+            KERNEL_STATS_ADD(sel->stats, sweeps, 1);
+            if (center_next_pivot(sel, copy_left, copy_right, &group_pivot) > 0) {
+                status = below_is_smaller
+                    ? center_select_group(sel, copy_left, copy_right, ranks, n_below, out, group_pivot, depth + 1)
+                    : center_select_group(sel, copy_left, copy_right, ranks + at_end, n_above,
+                                          out + at_end, group_pivot, depth + 1);
             }
-            goto cleanup;
-        }
+            if (status != CENTER_OK) return status;
 
-        /* === UPDATE BOUNDS === */
-        if (count_below_pivot < median_rank_low) {
-            for (int i = 0; i < n; i++) {
-                left_bounds[i] = i + partition_counts[i];
+            if (below_is_smaller) {
+                ranks += at_end;
+                out += at_end;
+                n_ranks = n_above;
+            } else {
+                n_ranks = n_below;
             }
+
+            /* The group overwrote the shared counts and chunk sizes: take a pass */
+            keep = CENTER_KEEP_ALL;
+            KERNEL_STATS_ADD(sel->stats, sweeps, 1);
+            active_set_size = center_next_pivot(sel, left_bounds, right_bounds, &pivot);
         } else {
-            for (int i = 0; i < n; i++) {
-                right_bounds[i] = i + partition_counts[i] - 1;
+            if (n_below > 0) {
+                keep = CENTER_KEEP_BELOW;
+                active_set_size = sweep.size_below;
+                n_ranks = n_below;
+            } else {
+                keep = CENTER_KEEP_ABOVE;
+                active_set_size = sweep.size_above;
+                ranks += at_end;
+                out += at_end;
+                n_ranks = n_above;
+            }
+            if (active_set_size > 0) {
+                pivot = center_chunk_pivot(sel, left_bounds, right_bounds, keep, active_set_size);
             }
-        }
-
-        /* === PREPARE NEXT ITERATION === */
-        previous_count = count_below_pivot;
-
-        active_set_size = 0;
-        for (int i = 0; i < n; i++) {
-            long long row_size = right_bounds[i] - left_bounds[i] + 1;
-            active_set_size += MAX(0, row_size);
         }
 
         /*
-         * Stall detection: on valid sorted input the active set strictly
-         * shrinks toward the target. If it fails to shrink for several
-         * consecutive iterations, the input is pathological (e.g.,
-         * assume_sorted=TRUE on unsorted data) and we bail deterministically.
+         * An empty or non-shrinking active set only happens on pathological
+         * input (e.g., assume_sorted=TRUE on unsorted data); bail out
+         * deterministically.
          */
+        if (active_set_size == 0) return CENTER_NO_CONVERGENCE;
         if (active_set_size >= previous_active_set_size && previous_active_set_size >= 0) {
-            if (++stall_count >= max_stall) {
-                break;
-            }
+            KERNEL_STATS_ADD(sel->stats, stall_passes, 1);
+            if (++stall_count >= max_stall) return CENTER_NO_CONVERGENCE;
         } else {
             stall_count = 0;
         }
         previous_active_set_size = active_set_size;
+    }
 
-        /* Choose next pivot */
-        if (active_set_size > 2) {
-            /* Deterministic pivot: pick middle element of active set */
-            long long target_index = active_set_size / 2;
-            int selected_row = 0;
-
-            long long cumulative_size = 0;
-            for (int i = 0; i < n; i++) {
-                long long row_size = MAX(0, right_bounds[i] - left_bounds[i] + 1);
-                if (target_index < cumulative_size + row_size) {
-                    selected_row = i;
-                    break;
-                }
-                cumulative_size += row_size;
-            }
+    return CENTER_OK;
+}
 
-            long long median_column_in_row = (left_bounds[selected_row] + right_bounds[selected_row]) / 2;
-            pivot = sorted_values[selected_row] + sorted_values[median_column_in_row];
-        } else {
-            double min_remaining_sum = INFINITY;
-            double max_remaining_sum = -INFINITY;
+/*
+ * Core multi-rank selection over the n(n+1)/2 pairwise averages.
+ * Uses Monahan's Algorithm 616 with deterministic pivot selection; see
+ * center_select_group for how the ranks share partition passes.
+ * The per-row and per-chunk arrays and the bounds copies live in the caller's
+ * `work` (layout as in center_work_size); never raises an R error. Work is
+ * counted into `stats` and every pass polls `budget`, unless NULL.
+ */
+static int center_ranks_select(const double *sorted_values, int n,
+                               const long long *ranks, int n_ranks, double *out,
+                               void *work, int threads, KernelStats *stats,
+                               KernelBudget *budget) {
+    if (n_ranks == 0) return CENTER_OK;
+    if (n == 1) {
+        for (int i = 0; i < n_ranks; i++) out[i] = sorted_values[0];
+        return CENTER_OK;
+    }
 
-            for (int i = 0; i < n; i++) {
-                if (left_bounds[i] > right_bounds[i]) continue;
+    size_t chunks = center_chunks(n);
+    int *left_bounds = (int *)((long long *)work + 2 * chunks);
+    int *right_bounds = left_bounds + n;
+
+    CenterSelection sel;
+    sel.sorted_values = sorted_values;
+    sel.n = n;
+    sel.below_counts = left_bounds + 2 * (size_t)n;
+    sel.at_or_below_counts = left_bounds + 3 * (size_t)n;
+    sel.chunk_below_sizes = (long long *)work;
+    sel.chunk_above_sizes = sel.chunk_below_sizes + chunks;
+    sel.copies = left_bounds + 4 * (size_t)n;
+    sel.blocks = center_blocks(n, threads);
+    sel.stats = stats;
+    sel.budget = budget;
 
-                double row_value = sorted_values[i];
-                double min_in_row = sorted_values[left_bounds[i]] + row_value;
-                double max_in_row = sorted_values[right_bounds[i]] + row_value;
+    /*
+     * Bound the selection loop. On valid sorted input the Monahan selection
+     * converges in O(log n) passes per rank group; this cap is far higher than
+     * ever needed for sorted input but guarantees termination on misuse (e.g.,
+     * assume_sorted=TRUE on UNSORTED input, which is undefined behavior and
+     * would otherwise wedge the process in an unkillable infinite loop inside
+     * the C extension). The cap scales with n so large valid inputs are never
+     * starved, and it counts EVERY pass across all rank groups.
+     */
+    const long long base_iterations = 256;
+    sel.iterations_left = (base_iterations + 4LL * n) * n_ranks;
 
-                if (min_in_row < min_remaining_sum) min_remaining_sum = min_in_row;
-                if (max_in_row > max_remaining_sum) max_remaining_sum = max_in_row;
-            }
+    for (int i = 0; i < n; i++) {
+        left_bounds[i] = i;
+        right_bounds[i] = n - 1;
+    }
 
-            pivot = 0.5 * min_remaining_sum + 0.5 * max_remaining_sum;
-            if (pivot <= min_remaining_sum || pivot > max_remaining_sum) {
-                pivot = max_remaining_sum;
-            }
+    double pivot = midpoint_fc(sorted_values[(n - 1) / 2], sorted_values[n / 2]);
+    return center_select_group(&sel, left_bounds, right_bounds, ranks, n_ranks, out, pivot, 0);
+}
 
-            if (min_remaining_sum == max_remaining_sum) {
-                result = pivot / 2.0;
-                goto cleanup;
-            }
-        }
-    }
+int center_ranks_compute_ws(const double *sorted_values, int n,
+                            const long long *ranks, int n_ranks, double *out,
+                            void *work, int threads, KernelBudget *budget) {
+    return center_ranks_select(sorted_values, n, ranks, n_ranks, out, work, threads, NULL, budget);
+}
 
-    /* Non-convergence: iteration cap reached or the stall guard tripped. */
-    if (allocated_sorted) free(sorted_values);
-    free(left_bounds);
-    free(right_bounds);
-    free(partition_counts);
+/*
+ * Scratch layout: the two per-chunk size arrays (long long), then the int
+ * arrays: left and right bounds, the two per-row counts, and one pair of bounds
+ * copies per divergence level (floor(log2(n_ranks)) of them).
+ */
+size_t center_work_size(int n, int n_ranks) {
+    int levels = 0;
+    while (n_ranks >>= 1) levels++;
+    return 2 * center_chunks(n) * sizeof(long long) + (4 + 2 * (size_t)levels) * n * sizeof(int);
+}
+
+/*
+ * center_ranks_compute_ws with its own working memory.
+ */
+int center_ranks_compute(const double *sorted_values, int n,
+                         const long long *ranks, int n_ranks, double *out) {
+    void *work = malloc(center_work_size(n, n_ranks));
+    if (!work) return CENTER_NO_MEMORY;
+    int status = center_ranks_compute_ws(sorted_values, n, ranks, n_ranks, out, work, 1, NULL);
+    free(work);
+    return status;
+}
+
+/* Raise the R error matching a non-OK center_ranks_compute status */
+static void center_fail(int status) {
+    if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+    if (status == CENTER_NO_MEMORY) {
+        error("center_impl: memory allocation failed");
+    }
     error("Convergence failure (pathological input)");
+}
 
-cleanup:
-    if (allocated_sorted) free(sorted_values);
-    free(left_bounds);
-    free(right_bounds);
-    free(partition_counts);
-    return result;
+/*
+ * Center (Hodges-Lehmann) estimate of sorted values with caller scratch:
+ * selects both middle ranks in one shared selection. Work is counted into
+ * `stats` and every pass polls `budget`, unless NULL.
+ */
+static int center_median_select(const double *sorted_values, int n, void *work, int threads,
+                                KernelStats *stats, KernelBudget *budget, double *out) {
+    if (n == 1) {
+        *out = sorted_values[0];
+        return CENTER_OK;
+    }
+    if (n == 2) {
+        *out = midpoint_fc(sorted_values[0], sorted_values[1]);
+        return CENTER_OK;
+    }
+
+    /* Calculate target median rank(s) */
+    long long total_pairs = ((long long)n * (n + 1)) / 2;
+    long long median_ranks[2] = { (total_pairs + 1) / 2, (total_pairs + 2) / 2 };
+    int n_ranks = median_ranks[0] < median_ranks[1] ? 2 : 1;
+    double median_values[2];
+
+    int status = center_ranks_select(sorted_values, n, median_ranks, n_ranks, median_values, work,
+                                     threads, stats, budget);
+    if (status != CENTER_OK) return status;
+
+    /* Even total: average the two middle values */
+    *out = n_ranks == 2 ? midpoint_fc(median_values[0], median_values[1]) : median_values[0];
+    return CENTER_OK;
+}
+
+int center_median_compute_ws(const double *sorted_values, int n, void *work, int threads,
+                             double *out, KernelBudget *budget) {
+    return center_median_select(sorted_values, n, work, threads, NULL, budget, out);
 }
 
 /*
- * R-callable wrapper for center_impl_compute.
+ * Core computation: Center (Hodges-Lehmann) estimator. The sorted copy and the
+ * selection scratch come from the shared R scratch arena, so repeated calls
+ * allocate nothing once the arena has grown to the sample size.
  */
-SEXP center_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
-    if (!isReal(values_sexp)) {
-        error("Input must be a numeric vector");
+double center_impl_compute(const double *values, int n, int assume_sorted, int threads,
+                           KernelStats *stats, KernelBudget *budget) {
+    if (n == 1) return values[0];
+    if (n == 2) return midpoint_fc(values[0], values[1]);
+
+    size_t copy_bytes = assume_sorted ? 0 : scratch_align(n * sizeof(double));
+    size_t work_bytes = center_work_size(n, 2);
+    if (!assume_sorted) work_bytes = MAX(work_bytes, sort_work_size(n));
+    work_bytes = MAX(work_bytes, ties_work_size(n / TIES_MAX_RUN_FRACTION));
+    char *scratch = (char *)r_scratch_reserve(copy_bytes + work_bytes);
+
+    /* Use input directly when sorted; otherwise sort a copy (the sort scratch is then reused) */
+    double mark = stats ? kernel_clock() : 0;
+    const double *sorted_values = values;
+    if (!assume_sorted) {
+        double *copy = (double *)scratch;
+        memcpy(copy, values, n * sizeof(double));
+        sort_doubles(copy, n, scratch + copy_bytes);
+        sorted_values = copy;
+    }
+    KERNEL_STATS_LAP(stats, sort_seconds, mark);
+
+    /* Heavily tied input: select over the distinct values (same result, and
+     * the weighted search terminates on any finite input; the WEIGHTED_*
+     * status codes coincide with CENTER_*) */
+    double result;
+    int status;
+    int runs = n >= TIES_MIN_SIZE ? sorted_runs(sorted_values, n) : n;
+    if (ties_compressible(n, runs)) {
+        if (stats) stats->ties_compressed = 1;
+        status = ties_center_compute_ws(sorted_values, 0, n, runs, scratch + copy_bytes, &result, stats,
+                                        budget);
+    } else {
+        status = center_median_select(sorted_values, n, scratch + copy_bytes, threads, stats, budget,
+                                      &result);
     }
+    KERNEL_STATS_LAP(stats, select_seconds, mark);
+    r_scratch_trim();
+    if (status != CENTER_OK) center_fail(status);
+
+    return result;
+}
 
+/*
+ * R-callable wrapper for center_impl_compute. With `diagnostics_sexp` TRUE
+ * the result carries the selection's work counters and timings as its
+ * "diagnostics" attribute (see kernel_stats.h). The selection polls for user
+ * interrupts and stops at `deadline_sexp` (see kernel_budget.h).
+ */
+SEXP center_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP diagnostics_sexp,
+                   SEXP deadline_sexp) {
     int n = length(values_sexp);
     if (n == 0) {
         error("Input vector cannot be empty");
     }
 
     int assume_sorted = asLogical(assume_sorted_sexp);
-    double result = center_impl_compute(REAL(values_sexp), n, assume_sorted);
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+    KernelStats record = { 0 };
+    KernelStats *stats = asLogical(diagnostics_sexp) == TRUE ? &record : NULL;
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    /* Integer input is selected as sorted ints, in place when assume_sorted;
+     * heavily tied ints go to the tie compression, which promotes only the
+     * distinct values */
+    double mark = stats ? kernel_clock() : 0;
+    int is_int;
+    const void *values = native_input(values_sexp, &assume_sorted, &is_int);
+    KERNEL_STATS_LAP(stats, sort_seconds, mark);
+    double result;
+    if (is_int) {
+        int status;
+        int runs = n >= TIES_MIN_SIZE ? sorted_int_runs(values, n) : n;
+        if (ties_compressible(n, runs)) {
+            if (stats) stats->ties_compressed = 1;
+            void *work = r_scratch_reserve(ties_work_size(runs));
+            status = ties_center_compute_ws(values, 1, n, runs, work, &result, stats, &budget);
+            r_scratch_trim();
+        } else {
+            SweepPairs pairs = { SWEEP_CENTER, 1, values, n, NULL, 0, threads };
+            status = sweep_median_compute(&pairs, &result, stats, &budget);
+        }
+        KERNEL_STATS_LAP(stats, select_seconds, mark);
+        if (status != CENTER_OK) center_fail(status);
+    } else {
+        result = center_impl_compute(values, n, assume_sorted, threads, stats, &budget);
+    }
 
     SEXP result_sexp = PROTECT(allocVector(REALSXP, 1));
     REAL(result_sexp)[0] = result;
+    if (stats) kernel_stats_attach(result_sexp, stats);
     UNPROTECT(1);
     return result_sexp;
 }
+
+/*
+ * R-callable wrapper for center_ranks_compute: pairwise-average order
+ * statistics for an arbitrary vector of 1-based ranks (any order, duplicates
+ * allowed). Ranks are doubles so that values beyond INT_MAX (n > ~65k) pass
+ * through R unchanged. Distinct ranks are selected together in one shared pass,
+ * which polls for user interrupts and stops at `deadline_sexp`.
+ */
+SEXP center_ranks_impl_c(SEXP values_sexp, SEXP ranks_sexp, SEXP assume_sorted_sexp, SEXP deadline_sexp) {
+    if (!isReal(values_sexp) || !isReal(ranks_sexp)) {
+        error("values and ranks must be numeric");
+    }
+
+    int n = length(values_sexp);
+    if (n == 0) {
+        error("Input vector cannot be empty");
+    }
+    int n_ranks = length(ranks_sexp);
+
+    /* Sort and deduplicate the requested ranks */
+    const double *requested = REAL(ranks_sexp);
+    long long *ranks = (long long *) R_alloc(MAX(n_ranks, 1), sizeof(long long));
+    for (int i = 0; i < n_ranks; i++) {
+        if (ISNAN(requested[i])) {
+            error("ranks must not be NA");
+        }
+        ranks[i] = (long long)requested[i];
+    }
+    qsort(ranks, n_ranks, sizeof(long long), cmp_rank_fc);
+    int n_unique = 0;
+    for (int i = 0; i < n_ranks; i++) {
+        if (n_unique == 0 || ranks[n_unique - 1] != ranks[i]) {
+            ranks[n_unique++] = ranks[i];
+        }
+    }
+
+    long long total_pairs = ((long long)n * (n + 1)) / 2;
+    if (n_unique > 0 && (ranks[0] < 1 || ranks[n_unique - 1] > total_pairs)) {
+        error("ranks must be between 1 and n(n+1)/2");
+    }
+
+    /* Sorted copy and selection scratch share the R scratch arena */
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    size_t copy_bytes = assume_sorted ? 0 : scratch_align(n * sizeof(double));
+    size_t work_bytes = center_work_size(n, n_unique);
+    if (!assume_sorted) work_bytes = MAX(work_bytes, sort_work_size(n));
+    char *scratch = (char *)r_scratch_reserve(copy_bytes + work_bytes);
+    const double *sorted_values = REAL(values_sexp);
+    if (!assume_sorted) {
+        double *copy = (double *)scratch;
+        memcpy(copy, sorted_values, n * sizeof(double));
+        sort_doubles(copy, n, scratch + copy_bytes);
+        sorted_values = copy;
+    }
+
+    double *rank_values = (double *) R_alloc(MAX(n_unique, 1), sizeof(double));
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    int status = center_ranks_select(sorted_values, n, ranks, n_unique, rank_values,
+                                     scratch + copy_bytes, 1, NULL, &budget);
+    r_scratch_trim();
+    if (status != CENTER_OK) center_fail(status);
+
+    SEXP result = PROTECT(allocVector(REALSXP, n_ranks));
+    double *result_ptr = REAL(result);
+    for (int i = 0; i < n_ranks; i++) {
+        long long rank = (long long)requested[i];
+        int lo = 0, hi = n_unique - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (ranks[mid] < rank) lo = mid + 1; else hi = mid;
+        }
+        result_ptr[i] = rank_values[lo];
+    }
+
+    UNPROTECT(1);
+    return result;
+}
+
+/*
+ * Counts of the pairwise averages midpoint_fc(x[i], x[j]), i <= j, of sorted
+ * NaN-free `sorted_values` strictly below and at or below `threshold`, as
+ * c(below, at_or_below), in one two-pointer sweep of the selection's row
+ * walk. The average of 1-based rank k then exceeds the threshold iff
+ * at_or_below < k, and lies below it iff below >= k, so verdicts against the
+ * bounds need no selection.
+ */
+SEXP center_count_impl_c(SEXP sorted_sexp, SEXP threshold_sexp) {
+    if (!isReal(sorted_sexp) || !isReal(threshold_sexp) || length(threshold_sexp) != 1) {
+        error("values and threshold must be numeric");
+    }
+    const double *values = REAL(sorted_sexp);
+    int n = length(sorted_sexp);
+    double threshold = REAL(threshold_sexp)[0];
+
+    long long below = 0;
+    long long at_or_below = 0;
+    int column_below = n - 1;
+    int column_at_or_below = n - 1;
+    for (int row = 0; row < n; row++) {
+        double row_value = values[row];
+        column_below = count_retreat_mid_ge(values, column_below, row, row_value, threshold);
+        column_at_or_below = count_retreat_mid_gt(values, column_at_or_below, row, row_value,
+                                                  threshold);
+        below += MAX(0, column_below - row + 1);
+        at_or_below += MAX(0, column_at_or_below - row + 1);
+    }
+
+    SEXP result = PROTECT(allocVector(REALSXP, 2));
+    REAL(result)[0] = (double)below;
+    REAL(result)[1] = (double)at_or_below;
+    UNPROTECT(1);
+    return result;
+}
@@ -1,6 +1,24 @@
 #ifndef CENTER_IMPL_H
 #define CENTER_IMPL_H
 
+#include <stddef.h>
+#include "kernel_stats.h"
+#include "kernel_budget.h"
+
+/* Status codes of center_ranks_compute */
+#define CENTER_OK 0
+#define CENTER_NO_MEMORY 1
+#define CENTER_NO_CONVERGENCE 2
+
+/* Most threads one selection splits its passes over */
+#define CENTER_MAX_THREADS 256
+
+/* Rows per chunk of the per-chunk active set sizes kept by the selection */
+#define CENTER_CHUNK_ROWS 512
+
+/* Scratch bytes center_ranks_compute_ws needs for n_ranks ranks of n values */
+size_t center_work_size(int n, int n_ranks);
+
 /*
  * Compute the Center (Hodges-Lehmann) estimator: median of all pairwise averages.
  * Uses Monahan's Algorithm 616 (1984) for O(n log n) computation.
@@ -8,8 +26,45 @@
  * The input array is NOT modified. When assume_sorted == 0 a sorted copy is made
  * internally; when assume_sorted != 0 the caller guarantees `values` is already
  * sorted ascending and no copy/sort is performed.
- * Caller is responsible for ensuring n > 0.
+ * With threads > 1 the O(n) passes of large inputs run on up to `threads`
+ * OpenMP threads; the result does not depend on the thread count.
+ * Work and timings are added to `stats` unless NULL (see kernel_stats.h), and
+ * the selection stops with an R error once `budget` (unless NULL) runs out
+ * (see kernel_budget.h). Caller is responsible for ensuring n > 0.
+ */
+double center_impl_compute(const double *values, int n, int assume_sorted, int threads,
+                           KernelStats *stats, KernelBudget *budget);
+
+/*
+ * Select several order statistics of the n(n+1)/2 pairwise averages
+ * (x[i] + x[j]) / 2, i <= j, in one shared Monahan selection: out[i] receives
+ * the average of 1-based rank ranks[i]. `sorted_values` must be sorted
+ * ascending and `ranks` ascending (duplicates allowed) within [1, n(n+1)/2].
+ * Never raises an R error; returns CENTER_OK or a failure status.
+ */
+int center_ranks_compute(const double *sorted_values, int n,
+                         const long long *ranks, int n_ranks, double *out);
+
+/*
+ * center_ranks_compute with caller-provided scratch of at least
+ * center_work_size(n, n_ranks) bytes, aligned for long long (e.g. from malloc
+ * or a ScratchArena); it is overwritten. Allocates nothing itself, so several
+ * estimators over one sample can share a single working buffer. `threads` as
+ * for center_impl_compute (1 keeps the selection on the calling thread). Every
+ * pass polls `budget` unless NULL, returning its stopped status once it runs
+ * out (see kernel_budget.h).
+ */
+int center_ranks_compute_ws(const double *sorted_values, int n,
+                            const long long *ranks, int n_ranks, double *out,
+                            void *work, int threads, KernelBudget *budget);
+
+/*
+ * Center estimate of `sorted_values` (sorted ascending) into *out, using
+ * caller-provided scratch of center_work_size(n, 2) bytes and polling `budget`
+ * as center_ranks_compute_ws does. Never raises an R error; returns CENTER_OK
+ * or a failure status.
  */
-double center_impl_compute(const double *values, int n, int assume_sorted);
+int center_median_compute_ws(const double *sorted_values, int n, void *work, int threads,
+                             double *out, KernelBudget *budget);
 
 #endif
@@ -0,0 +1,140 @@
+#include "count_kernels.h"
+
+/*
+ * No FP contraction in this file: a multiply-add fused into an FMA (e.g. when
+ * built with -mfma or -march=native) would round the scalar midpoints
+ * differently from the vector lanes, which multiply and add separately.
+ */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define COUNT_KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Scalar loops: the reference semantics, and the fallback on CPUs and
+ * compilers without AVX2.
+ */
+static int advance_gt_scalar(const double *y, int j, int n, double x, double threshold) {
+    while (j < n && x - y[j] > threshold) j++;
+    return j;
+}
+
+static int advance_ge_scalar(const double *y, int j, int n, double x, double threshold) {
+    while (j < n && x - y[j] >= threshold) j++;
+    return j;
+}
+
+static int retreat_mid_ge_scalar(const double *values, int c, int lo, double row_value, double pivot) {
+    while (c >= lo && 0.5 * row_value + 0.5 * values[c] >= pivot) c--;
+    return c;
+}
+
+static int retreat_mid_gt_scalar(const double *values, int c, int lo, double row_value, double pivot) {
+    while (c >= lo && 0.5 * row_value + 0.5 * values[c] > pivot) c--;
+    return c;
+}
+
+static int advance_gt_int_scalar(const int *y, int j, int n, double x, double threshold) {
+    while (j < n && x - (double)y[j] > threshold) j++;
+    return j;
+}
+
+static int retreat_mid_gt_int_scalar(const int *values, int c, int lo, double row_value, double pivot) {
+    while (c >= lo && 0.5 * row_value + 0.5 * (double)values[c] > pivot) c--;
+    return c;
+}
+
+static const CountKernels count_kernels_scalar = {
+    advance_gt_scalar, advance_ge_scalar, retreat_mid_ge_scalar, retreat_mid_gt_scalar,
+    advance_gt_int_scalar, retreat_mid_gt_int_scalar
+};
+
+CountKernels count_kernels = {
+    advance_gt_scalar, advance_ge_scalar, retreat_mid_ge_scalar, retreat_mid_gt_scalar,
+    advance_gt_int_scalar, retreat_mid_gt_int_scalar
+};
+
+#ifdef COUNT_KERNELS_AVX2
+
+/*
+ * Four columns per compare. The differences and midpoints are formed with
+ * the same IEEE operations as the scalar loops (subtract; multiply, multiply,
+ * add; no FMA, which avx2 alone does not enable and the pragma above keeps
+ * out of the scalar loops), and the ordered compares are false on NaN like
+ * the scalar ones, so every lane decides exactly as the scalar loop would.
+ * The first column that stops the scalar loop is the lowest (advance) or
+ * highest (retreat) clear bit of the lane mask; the tail shorter than a
+ * vector runs the scalar loop. `load` reads four columns as doubles:
+ * directly, or for the int instantiations through an exact four-lane
+ * int-to-double conversion. x86-64 only: on 32-bit x86 the scalar loops may
+ * run in x87 extended precision and decide differently.
+ */
+#define LOAD_DOUBLES(p) _mm256_loadu_pd(p)
+#define LOAD_INTS(p) _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(p)))
+
+#define COUNT_ADVANCE_AVX2(name, type, load, predicate, scalar)                      \
+    __attribute__((target("avx2")))                                                  \
+    static int name(const type *y, int j, int n, double x, double threshold) {       \
+        __m256d vx = _mm256_set1_pd(x);                                              \
+        __m256d vt = _mm256_set1_pd(threshold);                                      \
+        for (; j + 4 <= n; j += 4) {                                                 \
+            __m256d diff = _mm256_sub_pd(vx, load(y + j));                           \
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(diff, vt, predicate));       \
+            if (mask != 0xF) return j + __builtin_ctz(~mask);                        \
+        }                                                                            \
+        return scalar(y, j, n, x, threshold);                                        \
+    }
+
+#define COUNT_RETREAT_AVX2(name, type, load, predicate, scalar)                      \
+    __attribute__((target("avx2")))                                                  \
+    static int name(const type *values, int c, int lo, double row_value,             \
+                    double pivot) {                                                  \
+        __m256d half = _mm256_set1_pd(0.5);                                          \
+        __m256d vrow = _mm256_mul_pd(half, _mm256_set1_pd(row_value));               \
+        __m256d vp = _mm256_set1_pd(pivot);                                          \
+        for (; c - 3 >= lo; c -= 4) {                                                \
+            __m256d mid = _mm256_add_pd(                                             \
+                vrow, _mm256_mul_pd(half, load(values + c - 3)));                    \
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(mid, vp, predicate));        \
+            if (mask != 0xF) return c - 3 + (31 - __builtin_clz(~mask & 0xF));      \
+        }                                                                            \
+        return scalar(values, c, lo, row_value, pivot);                              \
+    }
+
+COUNT_ADVANCE_AVX2(advance_gt_avx2, double, LOAD_DOUBLES, _CMP_GT_OQ, advance_gt_scalar)
+COUNT_ADVANCE_AVX2(advance_ge_avx2, double, LOAD_DOUBLES, _CMP_GE_OQ, advance_ge_scalar)
+COUNT_RETREAT_AVX2(retreat_mid_ge_avx2, double, LOAD_DOUBLES, _CMP_GE_OQ, retreat_mid_ge_scalar)
+COUNT_RETREAT_AVX2(retreat_mid_gt_avx2, double, LOAD_DOUBLES, _CMP_GT_OQ, retreat_mid_gt_scalar)
+COUNT_ADVANCE_AVX2(advance_gt_int_avx2, int, LOAD_INTS, _CMP_GT_OQ, advance_gt_int_scalar)
+COUNT_RETREAT_AVX2(retreat_mid_gt_int_avx2, int, LOAD_INTS, _CMP_GT_OQ, retreat_mid_gt_int_scalar)
+
+#endif
+
+int count_kernels_select(int simd) {
+    count_kernels = count_kernels_scalar;
+#ifdef COUNT_KERNELS_AVX2
+    __builtin_cpu_init();
+    if (simd && __builtin_cpu_supports("avx2")) {
+        count_kernels.advance_gt = advance_gt_avx2;
+        count_kernels.advance_ge = advance_ge_avx2;
+        count_kernels.retreat_mid_ge = retreat_mid_ge_avx2;
+        count_kernels.retreat_mid_gt = retreat_mid_gt_avx2;
+        count_kernels.advance_gt_int = advance_gt_int_avx2;
+        count_kernels.retreat_mid_gt_int = retreat_mid_gt_int_avx2;
+        return 1;
+    }
+#else
+    (void) simd;
+#endif
+    return 0;
+}
+
+void count_kernels_init(void) {
+    count_kernels_select(1);
+}
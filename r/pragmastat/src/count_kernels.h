@@ -0,0 +1,76 @@
+#ifndef COUNT_KERNELS_H
+#define COUNT_KERNELS_H
+
+/*
+ * Pointer moves of the two-pointer counting sweeps (shift/ratio and center).
+ * Each kernel returns exactly the index the scalar loop in its comment would
+ * stop at; the AVX2 variants test four columns per compare and are chosen at
+ * package load when the CPU supports them (count_kernels_init), otherwise and
+ * on other architectures the scalar loops run. Touches no R API.
+ *
+ * The inline wrappers test the first column themselves, so a row whose
+ * pointer does not move (the common case on smooth data) costs no call.
+ * The _int instantiations read int columns, promoted to double before the
+ * same arithmetic (exact for every int), for the sweeps of integer input.
+ */
+typedef struct {
+    int (*advance_gt)(const double *y, int j, int n, double x, double threshold);
+    int (*advance_ge)(const double *y, int j, int n, double x, double threshold);
+    int (*retreat_mid_ge)(const double *values, int c, int lo, double row_value, double pivot);
+    int (*retreat_mid_gt)(const double *values, int c, int lo, double row_value, double pivot);
+    int (*advance_gt_int)(const int *y, int j, int n, double x, double threshold);
+    int (*retreat_mid_gt_int)(const int *values, int c, int lo, double row_value, double pivot);
+} CountKernels;
+
+extern CountKernels count_kernels;
+
+/* Selects the widest variant the CPU supports; call once before any sweep */
+void count_kernels_init(void);
+
+/*
+ * Selects the AVX2 variants when `simd` is nonzero and the CPU supports them,
+ * the scalar loops otherwise; returns whether the AVX2 variants are in use.
+ * For tests comparing the two tables; not safe while a sweep is running.
+ */
+int count_kernels_select(int simd);
+
+/* while (j < n && x - y[j] > threshold) j++; */
+static inline int count_advance_gt(const double *y, int j, int n, double x, double threshold) {
+    if (j >= n || !(x - y[j] > threshold)) return j;
+    return count_kernels.advance_gt(y, j + 1, n, x, threshold);
+}
+
+/* while (j < n && x - y[j] >= threshold) j++; */
+static inline int count_advance_ge(const double *y, int j, int n, double x, double threshold) {
+    if (j >= n || !(x - y[j] >= threshold)) return j;
+    return count_kernels.advance_ge(y, j + 1, n, x, threshold);
+}
+
+/* while (c >= lo && 0.5 * row_value + 0.5 * values[c] >= pivot) c--; */
+static inline int count_retreat_mid_ge(const double *values, int c, int lo,
+                                       double row_value, double pivot) {
+    if (c < lo || !(0.5 * row_value + 0.5 * values[c] >= pivot)) return c;
+    return count_kernels.retreat_mid_ge(values, c - 1, lo, row_value, pivot);
+}
+
+/* while (c >= lo && 0.5 * row_value + 0.5 * values[c] > pivot) c--; */
+static inline int count_retreat_mid_gt(const double *values, int c, int lo,
+                                       double row_value, double pivot) {
+    if (c < lo || !(0.5 * row_value + 0.5 * values[c] > pivot)) return c;
+    return count_kernels.retreat_mid_gt(values, c - 1, lo, row_value, pivot);
+}
+
+/* while (j < n && x - (double)y[j] > threshold) j++; */
+static inline int count_advance_gt_int(const int *y, int j, int n, double x, double threshold) {
+    if (j >= n || !(x - (double)y[j] > threshold)) return j;
+    return count_kernels.advance_gt_int(y, j + 1, n, x, threshold);
+}
+
+/* while (c >= lo && 0.5 * row_value + 0.5 * (double)values[c] > pivot) c--; */
+static inline int count_retreat_mid_gt_int(const int *values, int c, int lo,
+                                           double row_value, double pivot) {
+    if (c < lo || !(0.5 * row_value + 0.5 * (double)values[c] > pivot)) return c;
+    return count_kernels.retreat_mid_gt_int(values, c - 1, lo, row_value, pivot);
+}
+
+#endif
@@ -1,17 +1,92 @@
 #include <R.h>
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
+#include "count_kernels.h"
+#include "scratch_arena.h"
 
 // Forward declarations
-SEXP center_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp);
-SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp);
-SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp);
+SEXP center_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP diagnostics_sexp,
+                   SEXP deadline_sexp);
+SEXP center_ranks_impl_c(SEXP values_sexp, SEXP ranks_sexp, SEXP assume_sorted_sexp, SEXP deadline_sexp);
+SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP diagnostics_sexp,
+                   SEXP deadline_sexp);
+SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp, SEXP method_sexp,
+                  SEXP diagnostics_sexp, SEXP deadline_sexp);
+SEXP summary_impl_c(SEXP sorted_sexp, SEXP bounds_ranks_sexp, SEXP deadline_sexp);
+SEXP center_many_impl_c(SEXP groups_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP spread_many_impl_c(SEXP groups_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP shift_many_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp,
+                       SEXP deadline_sexp);
+SEXP sort_impl_c(SEXP values_sexp);
+SEXP window_new_c(SEXP capacity_sexp);
+SEXP window_push_c(SEXP ptr, SEXP values_sexp);
+SEXP window_values_c(SEXP ptr, SEXP sorted_sexp);
+SEXP window_center_c(SEXP ptr, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP window_spread_c(SEXP ptr, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP window_size_c(SEXP ptr);
+SEXP pairwise_margin_exact_impl_c(SEXP n_sexp, SEXP m_sexp, SEXP p_sexp, SEXP deadline_sexp);
+SEXP binom_cdf_split_impl_c(SEXP n_sexp, SEXP target_sexp);
+SEXP rng_new_c(SEXP seed_sexp);
+SEXP rng_uniform_float_c(SEXP ptr);
+SEXP rng_uniform_below_c(SEXP ptr, SEXP range_sexp);
+SEXP rng_shuffle_order_c(SEXP ptr, SEXP n_sexp);
+SEXP weighted_center_impl_c(SEXP sorted_sexp, SEXP weights_sexp, SEXP counts_sexp, SEXP deadline_sexp);
+SEXP weighted_shift_impl_c(SEXP x_sexp, SEXP x_weights_sexp, SEXP y_sexp, SEXP y_weights_sexp,
+                           SEXP deadline_sexp);
+SEXP spread_bounds_pairs_c(SEXP values_sexp, SEXP rng_ptr, SEXP k_left_sexp, SEXP k_right_sexp);
+SEXP center_count_impl_c(SEXP sorted_sexp, SEXP threshold_sexp);
+SEXP shift_count_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP threshold_sexp, SEXP exp_sexp);
+SEXP mapped_check_impl_c(SEXP path_sexp);
+SEXP mapped_center_impl_c(SEXP path_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP mapped_spread_impl_c(SEXP path_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP mapped_shift_impl_c(SEXP x_path_sexp, SEXP y_path_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+SEXP mapped_sort_impl_c(SEXP input_sexp, SEXP output_sexp, SEXP run_dir_sexp, SEXP chunk_sexp,
+                        SEXP deadline_sexp);
+SEXP simulate_impl_c(SEXP x_kind_sexp, SEXP x_params_sexp, SEXP y_kind_sexp, SEXP y_params_sexp,
+                     SEXP n_sexp, SEXP m_sexp, SEXP replicates_sexp, SEXP estimators_sexp,
+                     SEXP seed_sexp, SEXP threads_sexp, SEXP deadline_sexp);
+
+// Switches the pointer-move kernels between the AVX2 and the scalar table (tests only);
+// returns whether the AVX2 table is in use
+static SEXP count_kernels_select_c(SEXP simd_sexp) {
+    return ScalarLogical(count_kernels_select(asLogical(simd_sexp) == TRUE));
+}
 
 // Registration table
 static const R_CallMethodDef CallEntries[] = {
-    {"center_impl_c", (DL_FUNC) &center_impl_c, 2},
-    {"spread_impl_c", (DL_FUNC) &spread_impl_c, 2},
-    {"shift_impl_c", (DL_FUNC) &shift_impl_c, 4},
+    {"center_impl_c", (DL_FUNC) &center_impl_c, 5},
+    {"center_ranks_impl_c", (DL_FUNC) &center_ranks_impl_c, 4},
+    {"spread_impl_c", (DL_FUNC) &spread_impl_c, 5},
+    {"shift_impl_c", (DL_FUNC) &shift_impl_c, 7},
+    {"summary_impl_c", (DL_FUNC) &summary_impl_c, 3},
+    {"center_many_impl_c", (DL_FUNC) &center_many_impl_c, 4},
+    {"spread_many_impl_c", (DL_FUNC) &spread_many_impl_c, 4},
+    {"shift_many_impl_c", (DL_FUNC) &shift_many_impl_c, 5},
+    {"sort_impl_c", (DL_FUNC) &sort_impl_c, 1},
+    {"window_new_c", (DL_FUNC) &window_new_c, 1},
+    {"window_push_c", (DL_FUNC) &window_push_c, 2},
+    {"window_values_c", (DL_FUNC) &window_values_c, 2},
+    {"window_center_c", (DL_FUNC) &window_center_c, 3},
+    {"window_spread_c", (DL_FUNC) &window_spread_c, 3},
+    {"window_size_c", (DL_FUNC) &window_size_c, 1},
+    {"pairwise_margin_exact_impl_c", (DL_FUNC) &pairwise_margin_exact_impl_c, 4},
+    {"binom_cdf_split_impl_c", (DL_FUNC) &binom_cdf_split_impl_c, 2},
+    {"rng_new_c", (DL_FUNC) &rng_new_c, 1},
+    {"rng_uniform_float_c", (DL_FUNC) &rng_uniform_float_c, 1},
+    {"rng_uniform_below_c", (DL_FUNC) &rng_uniform_below_c, 2},
+    {"rng_shuffle_order_c", (DL_FUNC) &rng_shuffle_order_c, 2},
+    {"spread_bounds_pairs_c", (DL_FUNC) &spread_bounds_pairs_c, 4},
+    {"weighted_center_impl_c", (DL_FUNC) &weighted_center_impl_c, 4},
+    {"weighted_shift_impl_c", (DL_FUNC) &weighted_shift_impl_c, 5},
+    {"center_count_impl_c", (DL_FUNC) &center_count_impl_c, 2},
+    {"shift_count_impl_c", (DL_FUNC) &shift_count_impl_c, 4},
+    {"mapped_check_impl_c", (DL_FUNC) &mapped_check_impl_c, 1},
+    {"mapped_center_impl_c", (DL_FUNC) &mapped_center_impl_c, 3},
+    {"mapped_spread_impl_c", (DL_FUNC) &mapped_spread_impl_c, 3},
+    {"mapped_shift_impl_c", (DL_FUNC) &mapped_shift_impl_c, 4},
+    {"mapped_sort_impl_c", (DL_FUNC) &mapped_sort_impl_c, 5},
+    {"simulate_impl_c", (DL_FUNC) &simulate_impl_c, 11},
+    {"count_kernels_select_c", (DL_FUNC) &count_kernels_select_c, 1},
     {NULL, NULL, 0}
 };
 
@@ -19,4 +94,11 @@ static const R_CallMethodDef CallEntries[] = {
 void R_init_pragmastat(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    count_kernels_init();
+}
+
+// Package unload: release the shared scratch arena
+void R_unload_pragmastat(DllInfo *dll) {
+    (void) dll;
+    r_scratch_free();
 }
@@ -0,0 +1,76 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "kernel_budget.h"
+#include "kernel_stats.h"
+#include "scratch_arena.h"
+
+void kernel_budget_init(KernelBudget *budget, SEXP deadline_sexp) {
+    double deadline = asReal(deadline_sexp);
+    budget->deadline = ISNAN(deadline) ? INFINITY : deadline;
+    budget->next_interrupt_check = 0;
+    budget->stop = 0;
+}
+
+static void check_interrupt(void *unused) {
+    (void)unused;
+    R_CheckUserInterrupt();
+}
+
+/*
+ * The R thread: thread 0 of every enclosing parallel region, down from the
+ * outermost one it entered. Thread 0 of a team nested under a worker is a
+ * worker, and so is thread 1 of a team nested under the R thread.
+ */
+static inline int on_r_thread(void) {
+#ifdef _OPENMP
+    for (int level = omp_get_level(); level > 0; level--) {
+        if (omp_get_ancestor_thread_num(level) != 0) return 0;
+    }
+    return 1;
+#else
+    return 1;
+#endif
+}
+
+int kernel_budget_poll(KernelBudget *budget) {
+    if (!budget) return 0;
+    int stop;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    stop = budget->stop;
+    if (stop) return stop;
+
+    double now = kernel_clock();
+    if (now >= budget->deadline) {
+        stop = KERNEL_TIMED_OUT;
+    } else if (on_r_thread() && now >= budget->next_interrupt_check) {
+        budget->next_interrupt_check = now + KERNEL_INTERRUPT_INTERVAL;
+        // R_CheckUserInterrupt jumps out on an interrupt; R_ToplevelExec stops
+        // the jump here so the kernel can unwind and free its scratch first.
+        // The events it processes may re-enter the package, so nested calls
+        // get their own scratch while this kernel's slices stay in place.
+        ScratchArena suspended = r_scratch_suspend();
+        int completed = R_ToplevelExec(check_interrupt, NULL);
+        r_scratch_resume(suspended);
+        if (!completed) stop = KERNEL_INTERRUPTED;
+    }
+    if (stop) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+        budget->stop = stop;
+    }
+    return stop;
+}
+
+void kernel_budget_fail(int status) {
+    if (status == KERNEL_TIMED_OUT) {
+        error("time limit exceeded");
+    }
+    error("computation interrupted");
+}
@@ -0,0 +1,59 @@
+#ifndef KERNEL_BUDGET_H
+#define KERNEL_BUDGET_H
+
+/*
+ * Deadline and interrupt polling of one .Call. The selection loops poll their
+ * KernelBudget once per pass (kernels given NULL never stop); a poll that
+ * finds the deadline passed or a user interrupt pending makes the kernel
+ * return KERNEL_TIMED_OUT or KERNEL_INTERRUPTED instead of a result. The
+ * kernel unwinds through its normal status path, freeing what it malloc'd,
+ * and the entry point releases its scratch before kernel_budget_fail() raises
+ * the R error, so an abandoned call leaks nothing.
+ *
+ * The codes follow the kernels' own (*_OK 0, *_NO_MEMORY 1,
+ * *_NO_CONVERGENCE 2). The batched loops (many_impl.c, sim_impl.c) share one
+ * budget among their workers, which poll it between groups and inside their
+ * kernels: any thread may find the deadline passed, only thread 0 (the R
+ * thread) checks for an interrupt, and a stop is kept in `stop`, so
+ * every later poll on any thread returns it and the loop drains quickly.
+ *
+ * The interrupt check also processes pending events, whose handlers may call
+ * back into the package. The poll suspends the shared scratch arena around it
+ * (see r_scratch_suspend), so a nested kernel never moves the block the
+ * polling kernel is working in.
+ */
+#define KERNEL_INTERRUPTED 3
+#define KERNEL_TIMED_OUT 4
+
+/* Seconds between two checks for a pending user interrupt */
+#define KERNEL_INTERRUPT_INTERVAL 0.05
+
+typedef struct {
+    double deadline;              /* kernel_clock() reading to stop at */
+    double next_interrupt_check;  /* written by thread 0 only */
+    int stop;                     /* first stopped status, 0 while running */
+} KernelBudget;
+
+/*
+ * Budget of an entry point's `deadline_sexp` (seconds since the epoch, as
+ * as.numeric(Sys.time()); Inf or NA for no deadline). R API.
+ */
+struct SEXPREC;
+void kernel_budget_init(KernelBudget *budget, struct SEXPREC *deadline_sexp);
+
+/*
+ * KERNEL_TIMED_OUT past the deadline, KERNEL_INTERRUPTED on a pending user
+ * interrupt (which it consumes), otherwise 0; 0 for a NULL budget. Once one
+ * poll stops, every later one returns the same status. Costs one clock read,
+ * plus an R_CheckUserInterrupt() every KERNEL_INTERRUPT_INTERVAL on thread 0.
+ */
+int kernel_budget_poll(KernelBudget *budget);
+
+static inline int kernel_budget_stopped(int status) {
+    return status == KERNEL_INTERRUPTED || status == KERNEL_TIMED_OUT;
+}
+
+/* Raises the R error of a stopped status. R API */
+void kernel_budget_fail(int status);
+
+#endif
@@ -0,0 +1,37 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <time.h>
+#include "kernel_stats.h"
+
+double kernel_clock(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + 1e-9 * (double)now.tv_nsec;
+}
+
+void kernel_stats_attach(SEXP result, const KernelStats *stats) {
+    static const char *names[] = {
+        "passes", "sweeps", "stall_passes", "fallback_pivots", "max_search_passes",
+        "endgame", "ties_compressed", "sort_seconds", "select_seconds"
+    };
+    const int count = (int)(sizeof(names) / sizeof(names[0]));
+
+    SEXP list = PROTECT(allocVector(VECSXP, count));
+    SEXP list_names = PROTECT(allocVector(STRSXP, count));
+    for (int i = 0; i < count; i++) {
+        SET_STRING_ELT(list_names, i, mkChar(names[i]));
+    }
+    // Counts as doubles: pass totals of large selections may exceed INT_MAX
+    SET_VECTOR_ELT(list, 0, ScalarReal((double)stats->passes));
+    SET_VECTOR_ELT(list, 1, ScalarReal((double)stats->sweeps));
+    SET_VECTOR_ELT(list, 2, ScalarReal((double)stats->stall_passes));
+    SET_VECTOR_ELT(list, 3, ScalarReal((double)stats->fallback_pivots));
+    SET_VECTOR_ELT(list, 4, ScalarInteger(stats->max_search_passes));
+    SET_VECTOR_ELT(list, 5, ScalarLogical(stats->endgame));
+    SET_VECTOR_ELT(list, 6, ScalarLogical(stats->ties_compressed));
+    SET_VECTOR_ELT(list, 7, ScalarReal(stats->sort_seconds));
+    SET_VECTOR_ELT(list, 8, ScalarReal(stats->select_seconds));
+    setAttrib(list, R_NamesSymbol, list_names);
+    setAttrib(result, install("diagnostics"), list);
+    UNPROTECT(2);
+}
@@ -0,0 +1,69 @@
+#ifndef KERNEL_STATS_H
+#define KERNEL_STATS_H
+
+/*
+ * Work counters of one Center, Spread or Shift selection, filled in when the
+ * caller passes a KernelStats (kernels given NULL count nothing). Counters
+ * are only updated on the calling thread: blocks of a parallel pass add up to
+ * one sweep. Touches no R API; kernel_stats_attach() hands a record to R.
+ *
+ *   passes             iterations of the selection loop, each one partition
+ *                      sweep (for the bracketed searches, one probe)
+ *   sweeps             every O(n) pass over the rows: the passes plus the
+ *                      pivot recounts after a rank-group divergence, the
+ *                      stall and endgame scans of Spread and the full-range
+ *                      sweep that brackets a weighted search
+ *   stall_passes       passes that did not shrink the active set (for Spread,
+ *                      also the count-repeating passes of its stall handling)
+ *   fallback_pivots    Shift passes that used the Johnson-Mizoguchi pivot
+ *                      after two weak secant passes
+ *   max_search_passes  probes of the longest bracketed search (value
+ *                      bisection, which gives up at 128, the tie-compressed
+ *                      weighted search, at most 129, or the count-sweep
+ *                      selection of integer input, at most 256)
+ *   endgame            Spread finished from its few-candidates scan rather
+ *                      than at an exact target count
+ *   ties_compressed    the selection ran over the distinct values
+ *   sort_seconds       time spent converting and sorting the input
+ *   select_seconds     time spent in the selection itself
+ */
+typedef struct {
+    long long passes;
+    long long sweeps;
+    long long stall_passes;
+    long long fallback_pivots;
+    int max_search_passes;
+    int endgame;
+    int ties_compressed;
+    double sort_seconds;
+    double select_seconds;
+} KernelStats;
+
+/* Adds `k` to a counter of a possibly NULL record */
+#define KERNEL_STATS_ADD(stats, field, k) \
+    do { if (stats) (stats)->field += (k); } while (0)
+
+/* Wall-clock time in seconds (C11 timespec_get), for the two timings */
+double kernel_clock(void);
+
+/*
+ * Adds the time since `mark` (a kernel_clock() reading) to the `field`
+ * timing of a possibly NULL record and restarts `mark`
+ */
+#define KERNEL_STATS_LAP(stats, field, mark) \
+    do { \
+        if (stats) { \
+            double now_ = kernel_clock(); \
+            (stats)->field += now_ - (mark); \
+            (mark) = now_; \
+        } \
+    } while (0)
+
+/*
+ * Sets the "diagnostics" attribute of `result` to a named list of the
+ * record. R API: for the .Call entry points only.
+ */
+struct SEXPREC;
+void kernel_stats_attach(struct SEXPREC *result, const KernelStats *stats);
+
+#endif
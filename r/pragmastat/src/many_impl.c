@@ -0,0 +1,312 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "center_impl.h"
+#include "spread_impl.h"
+#include "shift_impl.h"
+#include "kernel_budget.h"
+#include "scratch_arena.h"
+#include "radix_sort.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#ifdef _OPENMP
+#define BATCH_THREAD_NUM() omp_get_thread_num()
+#else
+#define BATCH_THREAD_NUM() 0
+#endif
+
+/*
+ * Batched estimators over a list of samples: one .Call, one output vector and
+ * one scratch block from the R scratch arena sized to the largest group,
+ * reused by every group (and by the next call).
+ * Groups that are empty or hold NA/NaN/Inf get NA_real_ and are skipped; the R
+ * wrappers then raise the assumption_error the per-sample call would raise.
+ *
+ * With OpenMP, `threads` workers share the groups, each with a private slice
+ * of the scratch. Every group is computed by the same sequential kernel no
+ * matter which worker runs it, so results are bit-identical for any thread
+ * count. The R API is only touched on the calling thread: group pointers are
+ * collected before the parallel loop, and kernel failures are recorded per
+ * group and raised afterwards for the first failing group in order.
+ *
+ * The workers share one budget of the call's deadline (kernel_budget.h): each
+ * polls it before every group and inside its kernel, thread 0 also checks for
+ * a user interrupt, and once any poll stops the budget the remaining groups
+ * are skipped and the stop is raised after the loop.
+ */
+
+/* Read-only view of one group, collected on the calling thread */
+typedef struct {
+    const double *values;
+    int n;
+} BatchGroup;
+
+/* Checks that `groups_sexp` is a list of double vectors and collects them */
+static BatchGroup *collect_groups(SEXP groups_sexp, const char *name) {
+    if (!isNewList(groups_sexp)) {
+        error("%s must be a list of numeric vectors", name);
+    }
+    R_xlen_t n_groups = XLENGTH(groups_sexp);
+    BatchGroup *groups = (BatchGroup *) R_alloc(MAX(n_groups, 1), sizeof(BatchGroup));
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        SEXP group = VECTOR_ELT(groups_sexp, g);
+        if (!isReal(group)) {
+            error("%s must be a list of numeric vectors", name);
+        }
+        groups[g].values = REAL(group);
+        groups[g].n = length(group);
+    }
+    return groups;
+}
+
+static int max_group_size(const BatchGroup *groups, R_xlen_t n_groups) {
+    int size = 1;
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        size = MAX(size, groups[g].n);
+    }
+    return size;
+}
+
+/* Worker count: at least 1, at most one per group; 1 without OpenMP */
+static int batch_threads(SEXP threads_sexp, R_xlen_t n_groups) {
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+#ifdef _OPENMP
+    if (threads > n_groups) threads = n_groups > 0 ? (int)n_groups : 1;
+    return threads;
+#else
+    (void)n_groups;
+    return 1;
+#endif
+}
+
+/* Non-empty and finite, as check_validity requires */
+static int group_is_valid(const BatchGroup *group) {
+    if (group->n == 0) return 0;
+    for (int i = 0; i < group->n; i++) {
+        if (!R_FINITE(group->values[i])) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Sorted view of a group: the input itself, or a sorted copy in `buffer`,
+ * using `work` (sort_work_size bytes, free until the kernel runs) as the radix
+ * scratch. sort_doubles stays off the R API, so workers may call it.
+ */
+static const double *sorted_group(const BatchGroup *group, int assume_sorted, double *buffer, void *work) {
+    if (assume_sorted) return group->values;
+    memcpy(buffer, group->values, group->n * sizeof(double));
+    sort_doubles(buffer, group->n, work);
+    return buffer;
+}
+
+/*
+ * Per-worker scratch from the R scratch arena: `threads` slices of a sort
+ * buffer of `size` doubles followed by `work_bytes` of kernel scratch, each
+ * `*stride` bytes apart.
+ */
+static char *batch_scratch(int threads, int size, size_t work_bytes, size_t *stride) {
+    *stride = scratch_align(size * sizeof(double)) + scratch_align(work_bytes);
+    return (char *) r_scratch_reserve((size_t)threads * *stride);
+}
+
+/* Index of the first group whose kernel did not return `ok`, or -1 */
+static R_xlen_t first_failure(const int *status, R_xlen_t n_groups, int ok) {
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        if (status[g] != ok) return g;
+    }
+    return -1;
+}
+
+/*
+ * Center of every group of a list of numeric vectors.
+ *
+ * @param groups_sexp List of numeric vectors
+ * @param assume_sorted_sexp Logical: if TRUE, every group is already sorted
+ * @param threads_sexp Integer: number of worker threads
+ * @param deadline_sexp Numeric: deadline of the call (see kernel_budget.h)
+ * @return Numeric vector with one estimate per group (NA for invalid groups)
+ */
+SEXP center_many_impl_c(SEXP groups_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    BatchGroup *groups = collect_groups(groups_sexp, "x");
+    R_xlen_t n_groups = XLENGTH(groups_sexp);
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    int threads = batch_threads(threads_sexp, n_groups);
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    int size = max_group_size(groups, n_groups);
+    size_t stride;
+    char *scratch = batch_scratch(threads, size, MAX(center_work_size(size, 2), sort_work_size(size)), &stride);
+    size_t work_offset = scratch_align(size * sizeof(double));
+    int *status = (int *) R_alloc(MAX(n_groups, 1), sizeof(int));
+
+    SEXP result = PROTECT(allocVector(REALSXP, n_groups));
+    double *out = REAL(result);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        int t = BATCH_THREAD_NUM();
+        status[g] = kernel_budget_poll(&budget);
+        if (status[g] != CENTER_OK) continue;
+        if (!group_is_valid(&groups[g])) {
+            out[g] = NA_REAL;
+            continue;
+        }
+        char *slice = scratch + (size_t)t * stride;
+        const double *sorted_values = sorted_group(&groups[g], assume_sorted, (double *) slice, slice + work_offset);
+        status[g] = center_median_compute_ws(sorted_values, groups[g].n, slice + work_offset, 1, &out[g], &budget);
+    }
+
+    r_scratch_trim();
+    if (budget.stop) kernel_budget_fail(budget.stop);
+    if (first_failure(status, n_groups, CENTER_OK) >= 0) {
+        error("Convergence failure (pathological input)");
+    }
+    UNPROTECT(1);
+    return result;
+}
+
+/*
+ * Spread of every group of a list of numeric vectors. The sparity check
+ * (spread > 0) is left to the caller.
+ *
+ * @param groups_sexp List of numeric vectors
+ * @param assume_sorted_sexp Logical: if TRUE, every group is already sorted
+ * @param threads_sexp Integer: number of worker threads
+ * @param deadline_sexp Numeric: deadline of the call (see kernel_budget.h)
+ * @return Numeric vector with one estimate per group (NA for invalid groups)
+ */
+SEXP spread_many_impl_c(SEXP groups_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    BatchGroup *groups = collect_groups(groups_sexp, "x");
+    R_xlen_t n_groups = XLENGTH(groups_sexp);
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    int threads = batch_threads(threads_sexp, n_groups);
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    int size = max_group_size(groups, n_groups);
+    size_t stride;
+    char *scratch = batch_scratch(threads, size, MAX(spread_work_size(size), sort_work_size(size)), &stride);
+    size_t work_offset = scratch_align(size * sizeof(double));
+    int *status = (int *) R_alloc(MAX(n_groups, 1), sizeof(int));
+
+    SEXP result = PROTECT(allocVector(REALSXP, n_groups));
+    double *out = REAL(result);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        int t = BATCH_THREAD_NUM();
+        status[g] = kernel_budget_poll(&budget);
+        if (status[g] != SPREAD_OK) continue;
+        if (!group_is_valid(&groups[g])) {
+            out[g] = NA_REAL;
+            continue;
+        }
+        char *slice = scratch + (size_t)t * stride;
+        const double *sorted_values = sorted_group(&groups[g], assume_sorted, (double *) slice, slice + work_offset);
+        status[g] = spread_median_compute(sorted_values, groups[g].n, slice + work_offset, 1, &out[g], &budget);
+    }
+
+    r_scratch_trim();
+    if (budget.stop) kernel_budget_fail(budget.stop);
+    if (first_failure(status, n_groups, SPREAD_OK) >= 0) {
+        error("Convergence failure (pathological input)");
+    }
+    UNPROTECT(1);
+    return result;
+}
+
+/*
+ * Shift of every pair of groups (x[[g]], y[[g]]): the Type-7 median of the
+ * pairwise differences, as shift_impl_c computes it for p = 0.5.
+ *
+ * @param x_sexp List of numeric vectors
+ * @param y_sexp List of numeric vectors of the same length as x_sexp
+ * @param assume_sorted_sexp Logical: if TRUE, every group is already sorted
+ * @param threads_sexp Integer: number of worker threads
+ * @param deadline_sexp Numeric: deadline of the call (see kernel_budget.h)
+ * @return Numeric vector with one estimate per pair (NA for invalid pairs)
+ */
+SEXP shift_many_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp,
+                       SEXP deadline_sexp) {
+    BatchGroup *x_groups = collect_groups(x_sexp, "x");
+    BatchGroup *y_groups = collect_groups(y_sexp, "y");
+    R_xlen_t n_groups = XLENGTH(x_sexp);
+    if (XLENGTH(y_sexp) != n_groups) {
+        error("x and y must have the same number of groups");
+    }
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    int threads = batch_threads(threads_sexp, n_groups);
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    int x_size = max_group_size(x_groups, n_groups);
+    int y_size = max_group_size(y_groups, n_groups);
+    size_t work_bytes = sizeof(long long);
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        work_bytes = MAX(work_bytes, shift_work_size(x_groups[g].n, y_groups[g].n, 2));
+    }
+    work_bytes = MAX(work_bytes, sort_work_size(MAX(x_size, y_size)));
+
+    // Each worker's slice: x sort buffer, y sort buffer, then the kernel scratch
+    size_t y_offset = scratch_align(x_size * sizeof(double));
+    size_t work_offset = y_offset + scratch_align(y_size * sizeof(double));
+    size_t stride = work_offset + scratch_align(work_bytes);
+    char *scratch = (char *) r_scratch_reserve((size_t)threads * stride);
+    int *status = (int *) R_alloc(MAX(n_groups, 1), sizeof(int));
+
+    SEXP result = PROTECT(allocVector(REALSXP, n_groups));
+    double *out = REAL(result);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for (R_xlen_t g = 0; g < n_groups; g++) {
+        int t = BATCH_THREAD_NUM();
+        status[g] = kernel_budget_poll(&budget);
+        if (status[g] != SHIFT_OK) continue;
+        if (!group_is_valid(&x_groups[g]) || !group_is_valid(&y_groups[g])) {
+            out[g] = NA_REAL;
+            continue;
+        }
+        char *slice = scratch + (size_t)t * stride;
+        const double *xs = sorted_group(&x_groups[g], assume_sorted, (double *) slice, slice + work_offset);
+        const double *ys = sorted_group(&y_groups[g], assume_sorted, (double *) (slice + y_offset),
+                                        slice + work_offset);
+        int m = x_groups[g].n;
+        int n = y_groups[g].n;
+
+        long long total = (long long)m * n;
+        long long ranks[2] = { (total + 1) / 2, (total + 2) / 2 };
+        int n_ranks = ranks[0] < ranks[1] ? 2 : 1;
+        double values[2];
+        status[g] = shift_ranks_compute_ws(xs, m, ys, n, ranks, n_ranks, values, slice + work_offset, &budget);
+        out[g] = n_ranks == 2 ? 0.5 * values[0] + 0.5 * values[1] : values[0];
+    }
+
+    r_scratch_trim();
+    if (budget.stop) kernel_budget_fail(budget.stop);
+
+    R_xlen_t failed = first_failure(status, n_groups, SHIFT_OK);
+    if (failed >= 0) {
+        if (status[failed] == SHIFT_NO_MEMORY) {
+            error("shift_impl: memory allocation failed");
+        }
+        error("Convergence failure (pathological input)");
+    }
+    UNPROTECT(1);
+    return result;
+}
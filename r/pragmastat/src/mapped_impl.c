@@ -0,0 +1,524 @@
+/*
+ * File-backed estimation: Center, Spread and Shift of samples stored as raw
+ * native-endian float64 files, read through a read-only memory mapping
+ * instead of an R vector, plus the external merge sort that produces such
+ * sorted files from unsorted dumps.
+ *
+ * The kernels take the mapping as sorted input in place (assume_sorted), so
+ * the sample itself is never copied: its pages are faulted in by the
+ * sequential row sweeps of the selections and may be evicted again, which
+ * lets samples larger than RAM through. The selections are the count sweeps
+ * of sweep_select.h, which keep no per-row state, so Center, Spread and
+ * Shift need O(1) memory besides the mapping.
+ *
+ * Every resource (mapping, FILE) is released by an R_ExecWithCleanup
+ * handler, so an R error or interrupt inside a kernel leaks nothing.
+ */
+#include <R.h>
+#include <Rinternals.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "sweep_select.h"
+#include "radix_sort.h"
+#include "scratch_arena.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* The error of a file whose size is not a whole number of values */
+#define MAPPED_SIZE_ERROR "'%s' is not a float64 file (its size is not a multiple of 8 bytes)"
+
+/* Status codes of mapped_check_impl_c */
+#define MAPPED_OK 0
+#define MAPPED_INVALID 1
+#define MAPPED_UNSORTED 2
+
+/* Most run files one merge pass reads at once */
+#define MAPPED_MERGE_FAN_IN 64
+
+/* Values per buffered read of a run file and per buffered write */
+#define MAPPED_BLOCK_VALUES (1 << 16)
+
+typedef struct {
+    const double *data;
+    size_t n;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    size_t bytes;
+#endif
+} MappedFile;
+
+static const char *mapped_path(SEXP path_sexp) {
+    if (!isString(path_sexp) || length(path_sexp) != 1 || STRING_ELT(path_sexp, 0) == NA_STRING) {
+        error("path must be a single string");
+    }
+    /* R_ExpandFileName returns a static buffer: keep a copy per path */
+    const char *expanded = R_ExpandFileName(translateChar(STRING_ELT(path_sexp, 0)));
+    char *path = R_alloc(strlen(expanded) + 1, 1);
+    strcpy(path, expanded);
+    return path;
+}
+
+static void mapped_close(MappedFile *file) {
+#ifdef _WIN32
+    if (file->data) UnmapViewOfFile((void *)file->data);
+    if (file->mapping) CloseHandle(file->mapping);
+    if (file->file && file->file != INVALID_HANDLE_VALUE) CloseHandle(file->file);
+    file->mapping = NULL;
+    file->file = NULL;
+#else
+    if (file->data) munmap((void *)file->data, file->bytes);
+#endif
+    file->data = NULL;
+    file->n = 0;
+}
+
+/*
+ * Maps `path` read-only into `file` (zeroed by the caller, which closes it
+ * again). An empty file maps to n = 0 and data = NULL.
+ */
+static void mapped_open(MappedFile *file, const char *path) {
+#ifdef _WIN32
+    file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file->file == INVALID_HANDLE_VALUE) error("cannot open '%s'", path);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->file, &size)) error("cannot read the size of '%s'", path);
+    size_t bytes = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) error("cannot open '%s'", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        error("cannot read the size of '%s'", path);
+    }
+    size_t bytes = (size_t)st.st_size;
+#endif
+    if (bytes % sizeof(double) != 0) {
+#ifndef _WIN32
+        close(fd);
+#endif
+        error(MAPPED_SIZE_ERROR, path);
+    }
+    if (bytes / sizeof(double) > INT_MAX) {
+#ifndef _WIN32
+        close(fd);
+#endif
+        error("'%s' holds more than %d values", path, INT_MAX);
+    }
+    if (bytes == 0) {
+#ifndef _WIN32
+        close(fd);
+#endif
+        return;
+    }
+#ifdef _WIN32
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!file->mapping) error("cannot map '%s'", path);
+    file->data = (const double *)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!file->data) error("cannot map '%s'", path);
+#else
+    void *data = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) error("cannot map '%s'", path);
+    /* The selections sweep the rows in order: let the kernel read ahead */
+    posix_madvise(data, bytes, POSIX_MADV_SEQUENTIAL);
+    file->data = (const double *)data;
+    file->bytes = bytes;
+#endif
+    file->n = bytes / sizeof(double);
+}
+
+static void mapped_cleanup(void *data) {
+    MappedFile *files = (MappedFile *)data;
+    mapped_close(&files[0]);
+    mapped_close(&files[1]);
+}
+
+/* Mapped files of one entry point call, opened and read under cleanup */
+typedef struct {
+    MappedFile files[2];
+    const char *paths[2];
+    int threads;
+    KernelBudget budget;
+} MappedCall;
+
+static SEXP mapped_run(SEXP (*body)(void *), MappedCall *call) {
+    memset(call->files, 0, sizeof(call->files));
+    return R_ExecWithCleanup(body, call, mapped_cleanup, call->files);
+}
+
+static SEXP mapped_check_body(void *data) {
+    MappedCall *call = (MappedCall *)data;
+    MappedFile *file = &call->files[0];
+    mapped_open(file, call->paths[0]);
+
+    /* An unsorted file may still hold a NaN further on: scan it all */
+    int ascending = 1;
+    const double *v = file->data;
+    for (size_t i = 0; i < file->n; i++) {
+        if (!R_FINITE(v[i])) return ScalarInteger(MAPPED_INVALID);
+        if (i > 0 && v[i] < v[i - 1]) ascending = 0;
+    }
+    if (file->n == 0) return ScalarInteger(MAPPED_INVALID);
+    return ScalarInteger(ascending ? MAPPED_OK : MAPPED_UNSORTED);
+}
+
+/*
+ * One sequential pass over the file at `path`: MAPPED_OK when it holds at
+ * least one value, all finite and ascending; MAPPED_INVALID for an empty file
+ * or a NaN/infinite value anywhere in it, sorted or not; MAPPED_UNSORTED
+ * otherwise.
+ */
+SEXP mapped_check_impl_c(SEXP path_sexp) {
+    MappedCall call;
+    call.paths[0] = mapped_path(path_sexp);
+    return mapped_run(mapped_check_body, &call);
+}
+
+static int mapped_threads(SEXP threads_sexp) {
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+    return threads;
+}
+
+/*
+ * Median of the pair values of `kind` over the mapped file (and for Shift the
+ * second one), by count sweeps
+ */
+static SEXP mapped_median(MappedCall *call, SweepKind kind) {
+    int n_files = kind == SWEEP_SHIFT ? 2 : 1;
+    for (int i = 0; i < n_files; i++) {
+        mapped_open(&call->files[i], call->paths[i]);
+        if (call->files[i].n == 0) error("'%s' is empty", call->paths[i]);
+    }
+    SweepPairs pairs = { kind, 0, call->files[0].data, (int)call->files[0].n,
+                         call->files[1].data, (int)call->files[1].n, call->threads };
+    double out;
+    int status = sweep_median_compute(&pairs, &out, NULL, &call->budget);
+    if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+    if (status != SWEEP_OK) {
+        error("Convergence failure (pathological input)");
+    }
+    return ScalarReal(out);
+}
+
+static SEXP mapped_center_body(void *data) {
+    return mapped_median((MappedCall *)data, SWEEP_CENTER);
+}
+
+static SEXP mapped_spread_body(void *data) {
+    return mapped_median((MappedCall *)data, SWEEP_SPREAD);
+}
+
+static SEXP mapped_shift_body(void *data) {
+    return mapped_median((MappedCall *)data, SWEEP_SHIFT);
+}
+
+/*
+ * Center and Spread of the sorted float64 file at `path`, and Shift of the
+ * sorted files at `x_path` and `y_path`, read in place through the mapping.
+ * The files must have passed mapped_check_impl_c; unsorted files are
+ * undefined behavior as for assume_sorted = TRUE. The selections poll for
+ * user interrupts and stop at `deadline_sexp` (see kernel_budget.h); the
+ * cleanup of mapped_run unmaps the files either way.
+ */
+SEXP mapped_center_impl_c(SEXP path_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    MappedCall call;
+    call.paths[0] = mapped_path(path_sexp);
+    call.threads = mapped_threads(threads_sexp);
+    kernel_budget_init(&call.budget, deadline_sexp);
+    return mapped_run(mapped_center_body, &call);
+}
+
+SEXP mapped_spread_impl_c(SEXP path_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    MappedCall call;
+    call.paths[0] = mapped_path(path_sexp);
+    call.threads = mapped_threads(threads_sexp);
+    kernel_budget_init(&call.budget, deadline_sexp);
+    return mapped_run(mapped_spread_body, &call);
+}
+
+SEXP mapped_shift_impl_c(SEXP x_path_sexp, SEXP y_path_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    MappedCall call;
+    call.paths[0] = mapped_path(x_path_sexp);
+    call.paths[1] = mapped_path(y_path_sexp);
+    call.threads = mapped_threads(threads_sexp);
+    kernel_budget_init(&call.budget, deadline_sexp);
+    return mapped_run(mapped_shift_body, &call);
+}
+
+/*
+ * External merge sort. Chunks of `chunk` values are sorted in memory
+ * (sort_doubles) and written as run files into `run_dir`; merge passes of at
+ * most MAPPED_MERGE_FAN_IN runs then combine them, the last one into the
+ * output. Input and every run are read strictly sequentially through
+ * MAPPED_BLOCK_VALUES buffers.
+ */
+typedef struct {
+    FILE *input;
+    FILE *output;
+    FILE *runs[MAPPED_MERGE_FAN_IN];
+} SortFiles;
+
+typedef struct {
+    SortFiles files;
+    const char *input_path;
+    const char *output_path;
+    const char *run_dir;
+    int chunk;
+    KernelBudget budget;
+} SortCall;
+
+static void sort_cleanup(void *data) {
+    SortFiles *files = (SortFiles *)data;
+    if (files->input) fclose(files->input);
+    if (files->output) fclose(files->output);
+    for (int i = 0; i < MAPPED_MERGE_FAN_IN; i++) {
+        if (files->runs[i]) fclose(files->runs[i]);
+    }
+    memset(files, 0, sizeof(*files));
+}
+
+static FILE *sort_open(const char *path, const char *mode) {
+    FILE *f = fopen(path, mode);
+    if (!f) error("cannot open '%s'", path);
+    return f;
+}
+
+/*
+ * Rejects an input whose size is not a multiple of 8 bytes, as mapped_open
+ * does, before any run is written: fread would drop the trailing partial
+ * value silently.
+ */
+static void sort_check_size(FILE *f, const char *path) {
+#ifdef _WIN32
+    int failed = _fseeki64(f, 0, SEEK_END) != 0;
+    long long bytes = failed ? -1 : _ftelli64(f);
+#else
+    int failed = fseeko(f, 0, SEEK_END) != 0;
+    long long bytes = failed ? -1 : (long long)ftello(f);
+#endif
+    if (bytes < 0) error("cannot read the size of '%s'", path);
+    rewind(f);
+    if (bytes % sizeof(double) != 0) error(MAPPED_SIZE_ERROR, path);
+}
+
+static void sort_close(FILE **f, const char *path) {
+    int failed = fclose(*f) != 0;
+    *f = NULL;
+    if (failed) error("cannot write '%s'", path);
+}
+
+static void sort_write(FILE *f, const double *values, size_t n, const char *path) {
+    if (fwrite(values, sizeof(double), n, f) != n) error("cannot write '%s'", path);
+}
+
+static const char *run_path(const SortCall *call, int pass, int index) {
+    size_t size = strlen(call->run_dir) + 32;
+    char *path = R_alloc(size, 1);
+    snprintf(path, size, "%s/run-%d-%d.bin", call->run_dir, pass, index);
+    return path;
+}
+
+/*
+ * Polls the sort's budget: raises the time limit or interrupt error, after
+ * which sort_cleanup closes the files and mapped_sort() removes the runs
+ */
+static void sort_poll(SortCall *call) {
+    int status = kernel_budget_poll(&call->budget);
+    if (status) {
+        r_scratch_trim();
+        kernel_budget_fail(status);
+    }
+}
+
+/* Run of a merge pass: its block buffer and the position of its head value */
+typedef struct {
+    double *block;
+    size_t size;
+    size_t pos;
+} MergeRun;
+
+static int merge_refill(FILE *f, MergeRun *run, const char *path) {
+    run->size = fread(run->block, sizeof(double), MAPPED_BLOCK_VALUES, f);
+    run->pos = 0;
+    if (run->size == 0 && ferror(f)) error("cannot read '%s'", path);
+    return run->size > 0;
+}
+
+/* Restores the min-heap on run heads below `slot` */
+static void merge_sift_down(int *heap, int size, int slot, const MergeRun *runs) {
+    for (;;) {
+        int smallest = slot;
+        int left = 2 * slot + 1;
+        int right = left + 1;
+        if (left < size && runs[heap[left]].block[runs[heap[left]].pos] <
+                               runs[heap[smallest]].block[runs[heap[smallest]].pos]) {
+            smallest = left;
+        }
+        if (right < size && runs[heap[right]].block[runs[heap[right]].pos] <
+                                runs[heap[smallest]].block[runs[heap[smallest]].pos]) {
+            smallest = right;
+        }
+        if (smallest == slot) return;
+        int t = heap[slot];
+        heap[slot] = heap[smallest];
+        heap[smallest] = t;
+        slot = smallest;
+    }
+}
+
+/* Merges the sorted run files `paths[0..k)` into `out_path`, removing them */
+static void merge_runs(SortCall *call, const char **paths, int k, const char *out_path,
+                       double *blocks) {
+    SortFiles *files = &call->files;
+    MergeRun runs[MAPPED_MERGE_FAN_IN];
+    int heap[MAPPED_MERGE_FAN_IN];
+    int size = 0;
+
+    for (int r = 0; r < k; r++) {
+        files->runs[r] = sort_open(paths[r], "rb");
+        runs[r].block = blocks + (size_t)r * MAPPED_BLOCK_VALUES;
+        if (merge_refill(files->runs[r], &runs[r], paths[r])) heap[size++] = r;
+    }
+    for (int slot = size / 2 - 1; slot >= 0; slot--) merge_sift_down(heap, size, slot, runs);
+
+    files->output = sort_open(out_path, "wb");
+    double *out = blocks + (size_t)k * MAPPED_BLOCK_VALUES;
+    size_t n_out = 0;
+    while (size > 0) {
+        MergeRun *run = &runs[heap[0]];
+        out[n_out++] = run->block[run->pos++];
+        if (n_out == MAPPED_BLOCK_VALUES) {
+            sort_write(files->output, out, n_out, out_path);
+            n_out = 0;
+        }
+        if (run->pos == run->size) {
+            sort_poll(call);
+            if (!merge_refill(files->runs[heap[0]], run, paths[heap[0]])) heap[0] = heap[--size];
+        }
+        merge_sift_down(heap, size, 0, runs);
+    }
+    sort_write(files->output, out, n_out, out_path);
+    sort_close(&files->output, out_path);
+
+    for (int r = 0; r < k; r++) {
+        fclose(files->runs[r]);
+        files->runs[r] = NULL;
+        remove(paths[r]);
+    }
+}
+
+static SEXP sort_body(void *data) {
+    SortCall *call = (SortCall *)data;
+    SortFiles *files = &call->files;
+    files->input = sort_open(call->input_path, "rb");
+    sort_check_size(files->input, call->input_path);
+
+    /* Phase 1: sorted runs of `chunk` values (the whole input if it fits) */
+    double *chunk = (double *)R_alloc(call->chunk, sizeof(double));
+    void *sort_work = r_scratch_reserve(sort_work_size(call->chunk));
+    const char **paths = NULL;
+    int n_runs = 0;
+    int capacity = 0;
+    double total = 0;
+    for (;;) {
+        sort_poll(call);
+        size_t got = fread(chunk, sizeof(double), call->chunk, files->input);
+        if (got == 0) {
+            if (ferror(files->input)) error("cannot read '%s'", call->input_path);
+            break;
+        }
+        for (size_t i = 0; i < got; i++) {
+            if (!R_FINITE(chunk[i])) {
+                r_scratch_trim();
+                return ScalarReal(NA_REAL);
+            }
+        }
+        sort_doubles(chunk, (int)got, sort_work);
+        total += got;
+
+        /* A single chunk is the result */
+        if (n_runs == 0 && got < (size_t)call->chunk) {
+            files->output = sort_open(call->output_path, "wb");
+            sort_write(files->output, chunk, got, call->output_path);
+            sort_close(&files->output, call->output_path);
+            r_scratch_trim();
+            fclose(files->input);
+            files->input = NULL;
+            return ScalarReal(total);
+        }
+
+        if (n_runs == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            const char **grown = (const char **)R_alloc(capacity, sizeof(char *));
+            if (n_runs > 0) memcpy(grown, paths, n_runs * sizeof(char *));
+            paths = grown;
+        }
+        paths[n_runs] = run_path(call, 0, n_runs);
+        FILE *run = sort_open(paths[n_runs], "wb");
+        files->output = run;
+        sort_write(run, chunk, got, paths[n_runs]);
+        sort_close(&files->output, paths[n_runs]);
+        n_runs++;
+    }
+    r_scratch_trim();
+    fclose(files->input);
+    files->input = NULL;
+
+    if (n_runs == 0) {
+        return ScalarReal(NA_REAL);
+    }
+
+    /* Phase 2: merge passes of at most MAPPED_MERGE_FAN_IN runs */
+    double *blocks = (double *)R_alloc((size_t)(MAPPED_MERGE_FAN_IN + 1) * MAPPED_BLOCK_VALUES,
+                                       sizeof(double));
+    for (int pass = 1; n_runs > MAPPED_MERGE_FAN_IN; pass++) {
+        int merged = 0;
+        for (int first = 0; first < n_runs; first += MAPPED_MERGE_FAN_IN) {
+            int k = n_runs - first < MAPPED_MERGE_FAN_IN ? n_runs - first : MAPPED_MERGE_FAN_IN;
+            const char *out_path = run_path(call, pass, merged);
+            merge_runs(call, paths + first, k, out_path, blocks);
+            paths[merged++] = out_path;
+        }
+        n_runs = merged;
+    }
+    merge_runs(call, paths, n_runs, call->output_path, blocks);
+    return ScalarReal(total);
+}
+
+/*
+ * Sorts the float64 file at `input_path` into `output_path`, holding at most
+ * `chunk` values in memory and writing intermediate runs into the existing
+ * directory `run_dir`. Returns the number of values, or NA when the input is
+ * empty or holds a NaN/infinite value (then no output is written). Polls for
+ * user interrupts and stops at `deadline_sexp` (see kernel_budget.h) once per
+ * chunk and once per block a merge reads.
+ */
+SEXP mapped_sort_impl_c(SEXP input_sexp, SEXP output_sexp, SEXP run_dir_sexp, SEXP chunk_sexp,
+                        SEXP deadline_sexp) {
+    SortCall call;
+    memset(&call, 0, sizeof(call));
+    call.input_path = mapped_path(input_sexp);
+    call.output_path = mapped_path(output_sexp);
+    call.run_dir = mapped_path(run_dir_sexp);
+    call.chunk = asInteger(chunk_sexp);
+    if (call.chunk == NA_INTEGER || call.chunk < 1) {
+        error("chunk_size must be a positive integer");
+    }
+    kernel_budget_init(&call.budget, deadline_sexp);
+    return R_ExecWithCleanup(sort_body, &call, sort_cleanup, &call.files);
+}
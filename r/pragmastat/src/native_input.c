@@ -0,0 +1,45 @@
+#include <string.h>
+#include "native_input.h"
+#include "radix_sort.h"
+#include "scratch_arena.h"
+
+const void *native_input(SEXP x, int *assume_sorted, int *is_int) {
+    if (isReal(x)) {
+        *is_int = 0;
+        return REAL(x);
+    }
+    if (!isInteger(x)) {
+        error("Input must be a numeric vector");
+    }
+
+    int n = length(x);
+    const int *ints = INTEGER(x);
+    for (int i = 0; i < n; i++) {
+        if (ints[i] == NA_INTEGER) {
+            error("Input must not contain NA or NaN");
+        }
+    }
+    *is_int = 1;
+    if (*assume_sorted) {
+        return ints;
+    }
+
+    int *values = (int *)R_alloc(n > 0 ? n : 1, sizeof(int));
+    memcpy(values, ints, n * sizeof(int));
+    sort_ints(values, n, r_scratch_reserve(sort_work_size(n)));
+    r_scratch_trim();
+    *assume_sorted = 1;
+    return values;
+}
+
+const double *native_input_doubles(const void *values, int n, int is_int) {
+    if (!is_int) {
+        return (const double *)values;
+    }
+    const int *ints = (const int *)values;
+    double *promoted = (double *)R_alloc(n > 0 ? n : 1, sizeof(double));
+    for (int i = 0; i < n; i++) {
+        promoted[i] = (double)ints[i];
+    }
+    return promoted;
+}
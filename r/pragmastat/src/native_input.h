@@ -0,0 +1,30 @@
+#ifndef NATIVE_INPUT_H
+#define NATIVE_INPUT_H
+
+#include <R.h>
+#include <Rinternals.h>
+
+/*
+ * Numeric input of the .Call entry points (see R/native_input.R). A double
+ * vector is returned in place as const double * with *is_int set to 0. An
+ * integer vector (counters, tick timings) sets *is_int and is returned as
+ * const int *: in place when *assume_sorted (after an NA scan, so sorted
+ * integer input is never copied), otherwise as a sorted int copy in a
+ * transient R_alloc buffer, half the size of a double copy, and
+ * *assume_sorted is then set. The kernels select over such ints directly
+ * (see sweep_select.h), or over their distinct values when heavily tied (see
+ * weighted_impl.h); every int is exactly a double and the pair values
+ * are formed on the promoted values, so results match the double input's.
+ * Raises an R error for other types (isInteger excludes factors) and for NA
+ * integers.
+ */
+const void *native_input(SEXP x, int *assume_sorted, int *is_int);
+
+/*
+ * The values of native_input as doubles, for the kernels that read doubles
+ * only: `values` itself unless is_int, else an R_alloc copy of the n ints,
+ * promoted (and so sorted when they were).
+ */
+const double *native_input_doubles(const void *values, int n, int is_int);
+
+#endif
@@ -0,0 +1,99 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rmath.h>
+#include <limits.h>
+#include "scratch_arena.h"
+#include "kernel_budget.h"
+
+/*
+ * Inversed Loeffler (1982) recurrence for the exact distribution of the
+ * Mann-Whitney statistic U with sample sizes n and m.
+ *
+ * Returns the smallest u with P(U <= u) >= p, where `total` is choose(n + m, m).
+ * pmf[u] is the number of arrangements with U = u, computed as
+ * (1/u) * sum_{i<u} pmf[i] * sigma[u - i], with sigma[u] the sum of the
+ * divisors of u in 1..n minus those in m+1..m+n. `pmf` and `sigma` hold
+ * n * m + 2 entries each; U never exceeds n * m, so the recurrence reaches a
+ * zero term (and stops) within that range. Polls `budget` every
+ * PAIRWISE_MARGIN_POLL_STEPS terms and returns minus its status once it runs
+ * out. Touches no R API beyond the poll.
+ */
+#define PAIRWISE_MARGIN_POLL_STEPS 64
+
+static int pairwise_margin_exact_search(int n, int m, double p, double total,
+                                        double *pmf, double *sigma, KernelBudget *budget) {
+    int max_u = n * m + 1;
+    pmf[0] = 1.0;
+    sigma[0] = 0.0;
+    double cdf = 1.0 / total;
+    if (cdf >= p) {
+        return 0;
+    }
+
+    int u = 0;
+    while (u < max_u) {
+        u++;
+        if (u % PAIRWISE_MARGIN_POLL_STEPS == 0) {
+            int stop = kernel_budget_poll(budget);
+            if (stop) return -stop;
+        }
+
+        double value = 0.0;
+        for (int d = 1; d <= n && d <= u; d++) {
+            if (u % d == 0) value += d;
+        }
+        for (int d = m + 1; d <= m + n && d <= u; d++) {
+            if (u % d == 0) value -= d;
+        }
+        sigma[u] = value;
+
+        double sum = 0.0;
+        for (int i = 0; i < u; i++) {
+            sum += pmf[i] * sigma[u - i];
+        }
+        sum /= u;
+        pmf[u] = sum;
+
+        cdf += sum / total;
+        if (cdf >= p || sum == 0) {
+            return u;
+        }
+    }
+    return u;
+}
+
+/*
+ * R entry point of pairwise_margin_exact_raw: the one-tail exact margin (as a
+ * double, like the former R implementation) for sample sizes n and m and tail
+ * probability p. The recurrence arrays come from the R scratch arena. The
+ * recurrence polls for user interrupts and stops at `deadline_sexp`.
+ */
+SEXP pairwise_margin_exact_impl_c(SEXP n_sexp, SEXP m_sexp, SEXP p_sexp, SEXP deadline_sexp) {
+    double n_value = asReal(n_sexp);
+    double m_value = asReal(m_sexp);
+    double p = asReal(p_sexp);
+    if (ISNAN(n_value) || ISNAN(m_value) || n_value < 1 || m_value < 1 ||
+        n_value != floor(n_value) || m_value != floor(m_value)) {
+        error("n and m must be positive integers");
+    }
+    if (n_value * m_value + 2 > INT_MAX) {
+        error("n * m is too large for the exact margin");
+    }
+    if (ISNAN(p)) {
+        error("p must not be NaN");
+    }
+
+    int n = (int)n_value;
+    int m = (int)m_value;
+    double total = n + m < 62 ? choose(n + m, m) : exp(lchoose(n + m, m));
+
+    size_t entries = (size_t)n * m + 2;
+    double *pmf = r_scratch_reserve(2 * entries * sizeof(double));
+    double *sigma = pmf + entries;
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    int u = pairwise_margin_exact_search(n, m, p, total, pmf, sigma, &budget);
+    r_scratch_trim();
+    if (u < 0) kernel_budget_fail(-u);
+    return ScalarReal(u);
+}
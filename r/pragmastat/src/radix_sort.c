@@ -0,0 +1,256 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "radix_sort.h"
+#include "scratch_arena.h"
+
+#define RADIX_SIGN ((uint64_t)1 << 63)
+
+static int cmp_double_rs(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    if (da < db) return -1;
+    if (da > db) return 1;
+    return 0;
+}
+
+/* Unsigned key with the order of the double: flip all bits of negatives, the sign of the rest */
+static inline uint64_t radix_key(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & RADIX_SIGN) ? ~bits : bits | RADIX_SIGN;
+}
+
+static inline double radix_value(uint64_t key) {
+    uint64_t bits = (key & RADIX_SIGN) ? key & ~RADIX_SIGN : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* The double array doubles as the second key buffer: keys are moved bitwise */
+static inline uint64_t load_key(const double *slot) {
+    uint64_t key;
+    memcpy(&key, slot, sizeof(key));
+    return key;
+}
+
+static inline void store_key(double *slot, uint64_t key) {
+    memcpy(slot, &key, sizeof(key));
+}
+
+size_t sort_work_size(int n) {
+    return n < RADIX_SORT_MIN_N ? 0 : (size_t)n * sizeof(uint64_t);
+}
+
+void sort_doubles(double *values, int n, void *work) {
+    if (n < RADIX_SORT_MIN_N) {
+        qsort(values, n, sizeof(double), cmp_double_rs);
+        return;
+    }
+
+    // Keys and the histograms of all eight digits in one pass
+    uint64_t *keys = (uint64_t *)work;
+    size_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++) {
+        uint64_t key = radix_key(values[i]);
+        keys[i] = key;
+        for (int digit = 0; digit < 8; digit++) {
+            counts[digit][(key >> (8 * digit)) & 0xff]++;
+        }
+    }
+
+    // Stable scatter per digit, alternating between `keys` and `values`
+    uint64_t first_key = keys[0];
+    int in_keys = 1;
+    for (int digit = 0; digit < 8; digit++) {
+        int shift = 8 * digit;
+        const size_t *count = counts[digit];
+        if (count[(first_key >> shift) & 0xff] == (size_t)n) continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            offsets[byte] = offset;
+            offset += count[byte];
+        }
+
+        if (in_keys) {
+            for (int i = 0; i < n; i++) {
+                uint64_t key = keys[i];
+                store_key(&values[offsets[(key >> shift) & 0xff]++], key);
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                uint64_t key = load_key(&values[i]);
+                keys[offsets[(key >> shift) & 0xff]++] = key;
+            }
+        }
+        in_keys = !in_keys;
+    }
+
+    if (in_keys) {
+        for (int i = 0; i < n; i++) values[i] = radix_value(keys[i]);
+    } else {
+        for (int i = 0; i < n; i++) values[i] = radix_value(load_key(&values[i]));
+    }
+}
+
+size_t sort_weighted_work_size(int n) {
+    return n < RADIX_SORT_MIN_N ? 0 : 2 * (size_t)n * sizeof(uint64_t);
+}
+
+void sort_weighted_doubles(double *values, long long *weights, int n, void *work) {
+    if (n < RADIX_SORT_MIN_N) {
+        // Insertion sort: stable, and short inputs only
+        for (int i = 1; i < n; i++) {
+            double value = values[i];
+            long long weight = weights[i];
+            int j = i;
+            for (; j > 0 && values[j - 1] > value; j--) {
+                values[j] = values[j - 1];
+                weights[j] = weights[j - 1];
+            }
+            values[j] = value;
+            weights[j] = weight;
+        }
+        return;
+    }
+
+    // Keys, their weights and the histograms of all eight digits in one pass
+    uint64_t *keys = (uint64_t *)work;
+    long long *key_weights = (long long *)(keys + n);
+    size_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++) {
+        uint64_t key = radix_key(values[i]);
+        keys[i] = key;
+        key_weights[i] = weights[i];
+        for (int digit = 0; digit < 8; digit++) {
+            counts[digit][(key >> (8 * digit)) & 0xff]++;
+        }
+    }
+
+    // Stable scatter per digit, alternating between (keys, key_weights) and (values, weights)
+    uint64_t first_key = keys[0];
+    int in_keys = 1;
+    for (int digit = 0; digit < 8; digit++) {
+        int shift = 8 * digit;
+        const size_t *count = counts[digit];
+        if (count[(first_key >> shift) & 0xff] == (size_t)n) continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            offsets[byte] = offset;
+            offset += count[byte];
+        }
+
+        if (in_keys) {
+            for (int i = 0; i < n; i++) {
+                uint64_t key = keys[i];
+                size_t slot = offsets[(key >> shift) & 0xff]++;
+                store_key(&values[slot], key);
+                weights[slot] = key_weights[i];
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                uint64_t key = load_key(&values[i]);
+                size_t slot = offsets[(key >> shift) & 0xff]++;
+                keys[slot] = key;
+                key_weights[slot] = weights[i];
+            }
+        }
+        in_keys = !in_keys;
+    }
+
+    if (in_keys) {
+        for (int i = 0; i < n; i++) {
+            values[i] = radix_value(keys[i]);
+            weights[i] = key_weights[i];
+        }
+    } else {
+        for (int i = 0; i < n; i++) values[i] = radix_value(load_key(&values[i]));
+    }
+}
+
+static int cmp_int_rs(const void *a, const void *b) {
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+void sort_ints(int *values, int n, void *work) {
+    if (n < RADIX_SORT_MIN_N) {
+        qsort(values, n, sizeof(int), cmp_int_rs);
+        return;
+    }
+
+    // Keys (the value with its sign bit flipped) and all four histograms in one pass
+    uint32_t *keys = (uint32_t *)work;
+    size_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++) {
+        uint32_t key = (uint32_t)values[i] ^ 0x80000000u;
+        keys[i] = key;
+        for (int digit = 0; digit < 4; digit++) {
+            counts[digit][(key >> (8 * digit)) & 0xff]++;
+        }
+    }
+
+    // Stable scatter per digit, alternating between `keys` and `values`
+    uint32_t *slots = (uint32_t *)values;
+    uint32_t first_key = keys[0];
+    int in_keys = 1;
+    for (int digit = 0; digit < 4; digit++) {
+        int shift = 8 * digit;
+        const size_t *count = counts[digit];
+        if (count[(first_key >> shift) & 0xff] == (size_t)n) continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            offsets[byte] = offset;
+            offset += count[byte];
+        }
+
+        const uint32_t *from = in_keys ? keys : slots;
+        uint32_t *to = in_keys ? slots : keys;
+        for (int i = 0; i < n; i++) {
+            uint32_t key = from[i];
+            to[offsets[(key >> shift) & 0xff]++] = key;
+        }
+        in_keys = !in_keys;
+    }
+
+    const uint32_t *sorted = in_keys ? keys : slots;
+    for (int i = 0; i < n; i++) values[i] = (int)(sorted[i] ^ 0x80000000u);
+}
+
+/*
+ * R-callable ascending sort of a NaN-free numeric vector into a new vector,
+ * through sort_doubles with scratch from the R scratch arena.
+ */
+SEXP sort_impl_c(SEXP values_sexp) {
+    if (!isReal(values_sexp)) {
+        error("Input must be a numeric vector");
+    }
+    int n = length(values_sexp);
+    const double *values = REAL(values_sexp);
+    for (int i = 0; i < n; i++) {
+        if (ISNAN(values[i])) {
+            error("Input must not contain NA or NaN");
+        }
+    }
+
+    SEXP result = PROTECT(allocVector(REALSXP, n));
+    double *sorted = REAL(result);
+    memcpy(sorted, values, n * sizeof(double));
+    sort_doubles(sorted, n, r_scratch_reserve(sort_work_size(n)));
+    r_scratch_trim();
+    UNPROTECT(1);
+    return result;
+}
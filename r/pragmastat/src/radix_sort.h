@@ -0,0 +1,38 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stddef.h>
+
+/* Smallest n sort_doubles hands to the radix sort; shorter inputs use qsort */
+#define RADIX_SORT_MIN_N 512
+
+/* Scratch bytes sort_doubles needs for n values (0 below RADIX_SORT_MIN_N) */
+size_t sort_work_size(int n);
+
+/*
+ * Sorts n NaN-free doubles ascending in place: an LSD radix sort on the
+ * IEEE-754 bit pattern (sign-flipped so that unsigned order is numeric order,
+ * with -0 before +0), one 8-bit digit per pass, skipping digits all values
+ * share. `work` must hold sort_work_size(n) bytes aligned for long long.
+ * Never raises an R error and allocates nothing, so OpenMP workers may call it.
+ */
+void sort_doubles(double *values, int n, void *work);
+
+/* Scratch bytes sort_weighted_doubles needs for n values (0 below RADIX_SORT_MIN_N) */
+size_t sort_weighted_work_size(int n);
+
+/*
+ * Sorts n NaN-free doubles ascending in place as sort_doubles does, moving
+ * weights[i] along with values[i] (stable, so equal values keep their order).
+ * `work` must hold sort_weighted_work_size(n) bytes aligned for long long.
+ */
+void sort_weighted_doubles(double *values, long long *weights, int n, void *work);
+
+/*
+ * Sorts n ints ascending in place, as sort_doubles does (one 8-bit digit of
+ * the sign-flipped value per pass); `work` must hold sort_work_size(n) bytes,
+ * of which half are used.
+ */
+void sort_ints(int *values, int n, void *work);
+
+#endif
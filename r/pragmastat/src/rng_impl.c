@@ -0,0 +1,153 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rng_impl.h"
+
+uint64_t fnv1a_hash(const unsigned char *bytes, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x00000100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t splitmix64_next(uint64_t *state) {
+    *state += 0x9e3779b97f4a7c15ULL;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void xoshiro256_seed(Xoshiro256 *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64_next(&seed);
+    }
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t xoshiro256_next(Xoshiro256 *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+double xoshiro256_uniform_float(Xoshiro256 *rng) {
+    return (double)(xoshiro256_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t xoshiro256_uniform_below(Xoshiro256 *rng, uint64_t range) {
+    uint64_t value = xoshiro256_next(rng);
+    return range == 0 ? 0 : value % range;
+}
+
+void xoshiro256_shuffle_ints(Xoshiro256 *rng, int *values, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)xoshiro256_uniform_below(rng, (uint64_t)i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+}
+
+/*
+ * A numeric seed taken modulo 2^64, negative values in two's complement (so
+ * -1 is 0xFFFFFFFFFFFFFFFF), as the other ports read their signed seeds.
+ */
+static uint64_t seed_from_double(double seed) {
+    const double two_64 = 18446744073709551616.0;
+    double magnitude = fmod(fabs(trunc(seed)), two_64);
+    uint64_t value = (uint64_t)magnitude;
+    return seed < 0 ? (uint64_t)0 - value : value;
+}
+
+static void rng_finalize(SEXP ptr) {
+    free(R_ExternalPtrAddr(ptr));
+    R_ClearExternalPtr(ptr);
+}
+
+Xoshiro256 *rng_state(SEXP ptr) {
+    if (TYPEOF(ptr) != EXTPTRSXP) {
+        error("invalid random number generator");
+    }
+    Xoshiro256 *rng = (Xoshiro256 *) R_ExternalPtrAddr(ptr);
+    if (!rng) {
+        error("invalid random number generator");
+    }
+    return rng;
+}
+
+uint64_t rng_seed_value(SEXP seed_sexp) {
+    if (isString(seed_sexp) && length(seed_sexp) == 1 && STRING_ELT(seed_sexp, 0) != NA_STRING) {
+        const char *text = translateCharUTF8(STRING_ELT(seed_sexp, 0));
+        return fnv1a_hash((const unsigned char *) text, strlen(text));
+    }
+    if (isNumeric(seed_sexp) && length(seed_sexp) == 1 && R_FINITE(asReal(seed_sexp))) {
+        return seed_from_double(asReal(seed_sexp));
+    }
+    error("seed must be a single string or finite number");
+}
+
+/*
+ * New generator from a string seed (hashed with FNV-1a over its UTF-8 bytes)
+ * or a numeric one.
+ */
+SEXP rng_new_c(SEXP seed_sexp) {
+    uint64_t seed = rng_seed_value(seed_sexp);
+    Xoshiro256 *rng = (Xoshiro256 *) malloc(sizeof(Xoshiro256));
+    if (!rng) {
+        error("Memory allocation failed");
+    }
+    xoshiro256_seed(rng, seed);
+    SEXP ptr = PROTECT(R_MakeExternalPtr(rng, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, rng_finalize, TRUE);
+    UNPROTECT(1);
+    return ptr;
+}
+
+SEXP rng_uniform_float_c(SEXP ptr) {
+    return ScalarReal(xoshiro256_uniform_float(rng_state(ptr)));
+}
+
+/* Uniform integer in [0, range) as a double; range must be below 2^64 */
+SEXP rng_uniform_below_c(SEXP ptr, SEXP range_sexp) {
+    Xoshiro256 *rng = rng_state(ptr);
+    double range = asReal(range_sexp);
+    if (ISNAN(range) || range < 0 || range >= 18446744073709551616.0) {
+        error("range must be in [0, 2^64)");
+    }
+    return ScalarReal((double)xoshiro256_uniform_below(rng, (uint64_t)range));
+}
+
+/* 1-based permutation that Rng$shuffle applies to a vector of length n */
+SEXP rng_shuffle_order_c(SEXP ptr, SEXP n_sexp) {
+    Xoshiro256 *rng = rng_state(ptr);
+    int n = asInteger(n_sexp);
+    if (n == NA_INTEGER || n < 0) {
+        error("n must be a non-negative integer");
+    }
+    SEXP result = PROTECT(allocVector(INTSXP, n));
+    int *order = INTEGER(result);
+    for (int i = 0; i < n; i++) {
+        order[i] = i + 1;
+    }
+    xoshiro256_shuffle_ints(rng, order, n);
+    UNPROTECT(1);
+    return result;
+}
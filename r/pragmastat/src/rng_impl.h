@@ -0,0 +1,49 @@
+#ifndef RNG_IMPL_H
+#define RNG_IMPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * xoshiro256++ (https://prng.di.unimi.it/xoshiro256plusplus.c) seeded through
+ * SplitMix64, with string seeds hashed by 64-bit FNV-1a over their UTF-8
+ * bytes. Every draw matches the other Pragmastat ports bit for bit.
+ */
+typedef struct {
+    uint64_t s[4];
+} Xoshiro256;
+
+/* 64-bit FNV-1a hash of `length` bytes */
+uint64_t fnv1a_hash(const unsigned char *bytes, size_t length);
+
+/* Seeds the four state words with consecutive SplitMix64 outputs of `seed` */
+void xoshiro256_seed(Xoshiro256 *rng, uint64_t seed);
+
+uint64_t xoshiro256_next(Xoshiro256 *rng);
+
+/* Uniform double in [0, 1) from the upper 53 bits of the next draw */
+double xoshiro256_uniform_float(Xoshiro256 *rng);
+
+/* Uniform integer in [0, range), by modulo reduction; 0 when range is 0 */
+uint64_t xoshiro256_uniform_below(Xoshiro256 *rng, uint64_t range);
+
+/*
+ * Backward Fisher-Yates shuffle of `values`: for i = n-1 down to 1, swaps
+ * values[i] with values[j], j uniform in [0, i].
+ */
+void xoshiro256_shuffle_ints(Xoshiro256 *rng, int *values, int n);
+
+/*
+ * Generator behind an external pointer made by rng_new_c, for the .Call entry
+ * points on the main R thread. Raises an R error for anything else.
+ */
+struct SEXPREC;
+Xoshiro256 *rng_state(struct SEXPREC *ptr);
+
+/*
+ * 64-bit seed of a string (FNV-1a) or finite numeric (modulo 2^64) seed, as
+ * rng_new_c reads it. Raises an R error for anything else.
+ */
+uint64_t rng_seed_value(struct SEXPREC *seed_sexp);
+
+#endif
@@ -0,0 +1,61 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <stdlib.h>
+#include "scratch_arena.h"
+
+void *scratch_arena_reserve(ScratchArena *arena, size_t bytes) {
+    if (bytes == 0) bytes = 1;
+    if (arena->data && arena->size >= bytes) return arena->data;
+
+    // Grow geometrically so a run of slowly growing samples reallocates rarely
+    size_t size = arena->size * 2;
+    if (size < bytes) size = bytes;
+    free(arena->data);
+    arena->data = malloc(size);
+    if (!arena->data && size > bytes) {
+        size = bytes;
+        arena->data = malloc(size);
+    }
+    arena->size = arena->data ? size : 0;
+    return arena->data;
+}
+
+void scratch_arena_trim(ScratchArena *arena) {
+    if (arena->size > SCRATCH_ARENA_RETAIN_BYTES) scratch_arena_free(arena);
+}
+
+void scratch_arena_free(ScratchArena *arena) {
+    free(arena->data);
+    arena->data = NULL;
+    arena->size = 0;
+}
+
+static ScratchArena r_arena = { NULL, 0 };
+
+void *r_scratch_reserve(size_t bytes) {
+    void *data = scratch_arena_reserve(&r_arena, bytes);
+    if (!data) {
+        error("memory allocation failed");
+    }
+    return data;
+}
+
+void r_scratch_trim(void) {
+    scratch_arena_trim(&r_arena);
+}
+
+void r_scratch_free(void) {
+    scratch_arena_free(&r_arena);
+}
+
+ScratchArena r_scratch_suspend(void) {
+    ScratchArena suspended = r_arena;
+    r_arena.data = NULL;
+    r_arena.size = 0;
+    return suspended;
+}
+
+void r_scratch_resume(ScratchArena suspended) {
+    scratch_arena_free(&r_arena);
+    r_arena = suspended;
+}
@@ -0,0 +1,57 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Growable scratch block owned by the caller and reused across calls, so that
+ * repeated estimator calls on samples no larger than the last one allocate
+ * nothing. The contents do not survive a reserve that grows the block.
+ */
+typedef struct {
+    void *data;
+    size_t size;
+} ScratchArena;
+
+/* Largest block an arena keeps between calls (see scratch_arena_trim) */
+#define SCRATCH_ARENA_RETAIN_BYTES ((size_t)1 << 22)
+
+/*
+ * At least `bytes` bytes of scratch, aligned for double and long long (as from
+ * malloc), or NULL when out of memory. Never raises an R error.
+ */
+void *scratch_arena_reserve(ScratchArena *arena, size_t bytes);
+
+/* Frees the block if it exceeds SCRATCH_ARENA_RETAIN_BYTES */
+void scratch_arena_trim(ScratchArena *arena);
+
+/* Frees the block */
+void scratch_arena_free(ScratchArena *arena);
+
+/* Rounds `bytes` up to the alignment of the slices carved from one block */
+static inline size_t scratch_align(size_t bytes) {
+    return (bytes + sizeof(long long) - 1) / sizeof(long long) * sizeof(long long);
+}
+
+/*
+ * Scratch of the .Call entry points: one process-wide arena, reserved and
+ * trimmed on the main R thread only (workers just use slices of it). Raises an
+ * R error when out of memory.
+ */
+void *r_scratch_reserve(size_t bytes);
+void r_scratch_trim(void);
+void r_scratch_free(void);
+
+/*
+ * Re-entry. A kernel's interrupt check (kernel_budget_poll) runs R code, and
+ * an event handler there may call another entry point while the interrupted
+ * kernel and its workers still hold slices of the arena. The check therefore
+ * suspends the arena: the nested calls see an empty one and reserve blocks
+ * of their own, which r_scratch_resume() frees before it hands the suspended
+ * block back. Nesting follows the C stack, so it may go any number of levels
+ * deep.
+ */
+ScratchArena r_scratch_suspend(void);
+void r_scratch_resume(ScratchArena suspended);
+
+#endif
@@ -2,6 +2,14 @@
 #include <Rinternals.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include "shift_impl.h"
+#include "count_kernels.h"
+#include "weighted_impl.h"
+#include "scratch_arena.h"
+#include "radix_sort.h"
+#include "native_input.h"
+#include "sweep_select.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -33,9 +41,7 @@ static void count_and_neighbors(
     int j = 0;
     for (int i = 0; i < m; i++) {
         // Find the first y[j] where x[i] - y[j] <= threshold
-        while (j < n && x[i] - y[j] > threshold) {
-            j++;
-        }
+        j = count_advance_gt(y, j, n, x[i], threshold);
 
         // All pairs (x[i], y[k]) for k >= j satisfy x[i] - y[k] <= threshold
         count += (n - j);
@@ -66,13 +72,47 @@ static void count_and_neighbors(
 }
 
 /*
- * Binary search to find the k-th smallest pairwise difference.
+ * Log of every threshold probed while selecting ranks over the same (x, y).
+ * Each probe pins the number of differences <= its threshold, so it brackets
+ * any later rank k: if count_le >= k the k-th difference is <= closest_below,
+ * otherwise it is >= closest_above.
+ */
+typedef struct {
+    long long count_le;
+    double closest_below;
+    double closest_above;
+} SearchProbe;
+
+typedef struct {
+    SearchProbe *probes;
+    int size;
+    int capacity;
+} SearchLog;
+
+/*
+ * Bracketed search for the k-th smallest pairwise difference.
  * Returns the actual difference value at rank k (1-indexed).
+ *
+ * The bracket [search_min, search_max] always holds actual differences with
+ * known counts: `count_below_min` differences lie strictly below search_min
+ * and `count_at_or_below_max` at or below search_max. The next threshold is
+ * interpolated on those counts (most sweeps land close to rank k on smooth
+ * data), falling back to the value midpoint whenever an interpolated step fails
+ * to halve the rank interval, so convergence is never slower than plain
+ * bisection by more than a factor of two.
+ *
+ * When `log` is non-NULL, the search starts from the tightest bracket implied
+ * by earlier probes and appends its own probes for later searches. Probes are
+ * counted into `stats` unless NULL, and every probe polls `budget` (raising
+ * the R error once it runs out).
  */
 static double select_kth_pairwise_diff(
     const double *x, int m,
     const double *y, int n,
-    long long k)
+    long long k,
+    SearchLog *log,
+    KernelStats *stats,
+    KernelBudget *budget)
 {
     long long total = (long long)m * n;
 
@@ -82,42 +122,80 @@ static double select_kth_pairwise_diff(
 
     double search_min = x[0] - y[n - 1];
     double search_max = x[m - 1] - y[0];
+    long long count_below_min = 0;
+    long long count_at_or_below_max = total;
 
     if (ISNAN(search_min) || ISNAN(search_max)) {
         error("NaN in input values");
     }
 
+    if (log) {
+        for (int i = 0; i < log->size; i++) {
+            const SearchProbe *probe = &log->probes[i];
+            if (probe->count_le >= k) {
+                if (probe->closest_below < search_max) {
+                    search_max = probe->closest_below;
+                    count_at_or_below_max = probe->count_le;
+                }
+            } else {
+                if (probe->closest_above > search_min) {
+                    search_min = probe->closest_above;
+                    count_below_min = probe->count_le;
+                }
+            }
+        }
+    }
+
     const int max_iterations = 128;
-    double prev_min = R_NegInf;
-    double prev_max = R_PosInf;
+    int interpolate = 1;
+
+    int iter = 0;
+    for (; iter < max_iterations && search_min != search_max; iter++) {
+        int stop = kernel_budget_poll(budget);
+        if (stop) kernel_budget_fail(stop);
+        long long previous_width = count_at_or_below_max - count_below_min;
+
+        double mid;
+        if (interpolate) {
+            double fraction = ((double)(k - count_below_min) - 0.5) / (double)previous_width;
+            mid = (1.0 - fraction) * search_min + fraction * search_max;
+        } else {
+            mid = midpoint(search_min, search_max);
+        }
+        // Any threshold in [search_min, search_max) discards at least one value
+        if (!(mid >= search_min && mid < search_max)) {
+            mid = search_min;
+        }
 
-    for (int iter = 0; iter < max_iterations && search_min != search_max; iter++) {
-        double mid = midpoint(search_min, search_max);
         long long count_le;
         double closest_below, closest_above;
 
         count_and_neighbors(x, m, y, n, mid,
                           &count_le, &closest_below, &closest_above);
 
-        if (closest_below == closest_above) {
-            return closest_below;
-        }
-
-        // No progress means we're stuck between two discrete values
-        if (search_min == prev_min && search_max == prev_max) {
-            return count_le >= k ? closest_below : closest_above;
+        if (log && log->size < log->capacity) {
+            SearchProbe *probe = &log->probes[log->size++];
+            probe->count_le = count_le;
+            probe->closest_below = closest_below;
+            probe->closest_above = closest_above;
         }
 
-        prev_min = search_min;
-        prev_max = search_max;
-
         if (count_le >= k) {
             search_max = closest_below;
+            count_at_or_below_max = count_le;
         } else {
             search_min = closest_above;
+            count_below_min = count_le;
         }
+
+        // Interpolate again only while it keeps at least halving the rank interval
+        interpolate = 2 * (count_at_or_below_max - count_below_min) <= previous_width;
     }
 
+    KERNEL_STATS_ADD(stats, passes, iter);
+    KERNEL_STATS_ADD(stats, sweeps, iter);
+    if (stats && iter > stats->max_search_passes) stats->max_search_passes = iter;
+
     if (search_min != search_max) {
         error("Convergence failure (pathological input)");
     }
@@ -125,57 +203,455 @@ static double select_kth_pairwise_diff(
     return search_min;
 }
 
+static int cmp_rank(const void *a, const void *b) {
+    long long ra = *(const long long *)a;
+    long long rb = *(const long long *)b;
+    if (ra < rb) return -1;
+    if (ra > rb) return 1;
+    return 0;
+}
+
+/* Index of `rank` in the ascending, duplicate-free `ranks` array */
+static int find_rank(const long long *ranks, int n_ranks, long long rank) {
+    int lo = 0, hi = n_ranks - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ranks[mid] < rank) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
 /*
- * Computes quantiles of all pairwise differences { x_i - y_j }.
- * Time: O((m + n) * log(precision)) per quantile. Space: O(1).
- *
- * @param x_sexp Numeric vector (will be sorted if needed)
- * @param y_sexp Numeric vector (will be sorted if needed)
- * @param p_sexp Numeric vector of probabilities in [0, 1]
- * @param assume_sorted_sexp Logical: if TRUE, assume x and y are already sorted
- * @return Numeric vector of quantile values
+ * Rank-based selection
+ * --------------------
+ * The differences form an m x n matrix whose rows are the shorter sample and
+ * whose columns are the longer one taken in reverse, so that
+ * D(r, c) = rows[r] - cols[n_cols - 1 - c] ascends along both axes. As in
+ * center_impl's Monahan selection, every pass partitions the active set (per-row
+ * column bounds) around one pivot and discards a whole side by rank, so the
+ * number of passes depends only on m and n, never on how the values are spread.
  */
-SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp) {
-    // Input validation
-    if (!isReal(x_sexp) || !isReal(y_sexp) || !isReal(p_sexp)) {
-        error("x, y, and p must be numeric vectors");
+typedef struct {
+    double value;
+    long long weight;
+} WeightedValue;
+
+typedef struct {
+    const double *rows;
+    int n_rows;
+    const double *cols;
+    int n_cols;
+    long long *below_counts;
+    long long *at_or_below_counts;
+    WeightedValue *candidates;
+    long long *copies;
+    long long iterations_left;
+    KernelStats *stats;
+    KernelBudget *budget;
+} ShiftSelection;
+
+static inline double shift_diff(const ShiftSelection *sel, int row, long long col) {
+    return sel->rows[row] - sel->cols[sel->n_cols - 1 - col];
+}
+
+/*
+ * Smallest value among items[0..count) whose cumulative weight (over items
+ * <= it) reaches `need`. Quickselect with a median-of-three pivot and a
+ * three-way partition; reorders the items. Expected linear time.
+ */
+static double weighted_select(WeightedValue *items, int count, long long need) {
+    int lo = 0, hi = count - 1;
+    while (lo < hi) {
+        double a = items[lo].value;
+        double b = items[lo + (hi - lo) / 2].value;
+        double c = items[hi].value;
+        double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a))
+                               : ((a < c) ? a : ((b < c) ? c : b));
+
+        // [lo, lt) < pivot, [lt, i) == pivot, (gt, hi] > pivot
+        int lt = lo, i = lo, gt = hi;
+        long long weight_less = 0, weight_equal = 0;
+        while (i <= gt) {
+            WeightedValue item = items[i];
+            if (item.value < pivot) {
+                items[i++] = items[lt];
+                items[lt++] = item;
+                weight_less += item.weight;
+            } else if (item.value > pivot) {
+                items[i] = items[gt];
+                items[gt--] = item;
+            } else {
+                weight_equal += item.weight;
+                i++;
+            }
+        }
+
+        if (need <= weight_less) {
+            hi = lt - 1;
+        } else if (need <= weight_less + weight_equal) {
+            return pivot;
+        } else {
+            need -= weight_less + weight_equal;
+            lo = gt + 1;
+        }
     }
-    if (!isLogical(assume_sorted_sexp)) {
-        error("assume_sorted must be logical");
+    return items[lo].value;
+}
+
+/*
+ * Johnson-Mizoguchi pivot: the weighted median of the row medians of the active
+ * set, each weighted by its row's active length. At least a quarter of the
+ * active cells lie on each side of it, so a pass that uses it discards a
+ * constant share of the active set.
+ */
+static double shift_median_pivot(ShiftSelection *sel,
+                                 const long long *left_bounds,
+                                 const long long *right_bounds,
+                                 long long active_set_size) {
+    int count = 0;
+    for (int row = 0; row < sel->n_rows; row++) {
+        long long row_size = right_bounds[row] - left_bounds[row] + 1;
+        if (row_size <= 0) continue;
+        long long median_column = left_bounds[row] + (row_size - 1) / 2;
+        sel->candidates[count].value = shift_diff(sel, row, median_column);
+        sel->candidates[count].weight = row_size;
+        count++;
     }
+    return weighted_select(sel->candidates, count, (active_set_size + 1) / 2);
+}
 
-    int m = length(x_sexp);
-    int n = length(y_sexp);
-    int np = length(p_sexp);
+/* Keep only the differences strictly below the last pivot; returns the new active set size */
+static long long shift_keep_below(int n_rows, const long long *left_bounds,
+                                  long long *right_bounds, const long long *below_counts) {
+    long long active_set_size = 0;
+    for (int row = 0; row < n_rows; row++) {
+        right_bounds[row] = MIN(right_bounds[row], below_counts[row] - 1);
+        active_set_size += MAX(0, right_bounds[row] - left_bounds[row] + 1);
+    }
+    return active_set_size;
+}
 
-    if (m == 0 || n == 0) {
-        error("x and y must be non-empty");
+/* Keep only the differences strictly above the last pivot; returns the new active set size */
+static long long shift_keep_above(int n_rows, long long *left_bounds,
+                                  const long long *right_bounds, const long long *at_or_below_counts) {
+    long long active_set_size = 0;
+    for (int row = 0; row < n_rows; row++) {
+        left_bounds[row] = MAX(left_bounds[row], at_or_below_counts[row]);
+        active_set_size += MAX(0, right_bounds[row] - left_bounds[row] + 1);
     }
+    return active_set_size;
+}
 
-    double *p = REAL(p_sexp);
-    for (int i = 0; i < np; i++) {
-        if (ISNAN(p[i]) || p[i] < 0.0 || p[i] > 1.0) {
-            error("Probabilities must be within [0, 1]");
+/*
+ * Select the differences of rank ranks[0..n_ranks) (ascending, 1-based), all of
+ * which lie inside the active set described by left_bounds/right_bounds:
+ * `active_set_size` cells whose values span [active_min, active_max], with
+ * `count_below_active` differences below them.
+ *
+ * Each pass counts differences strictly below and at-or-below one pivot, so
+ * ties resolve exactly, and discards a whole side by rank. The pivot aims at
+ * the middle requested rank through a secant on the two latest (value, rank)
+ * probes, which lands close to it on smooth data. After two consecutive passes
+ * that each discard less than a quarter of the active set, the next one uses
+ * the Johnson-Mizoguchi pivot, so every three passes shrink the active set by
+ * at least a quarter and the worst case stays O((m + n) log(mn)) per rank
+ * group whatever the values look like. Ranks share passes while they fall on
+ * the same side of the pivot; once they diverge the smaller group continues on
+ * a private copy of the bounds, like center_select_group: one pair per nesting
+ * `depth`, preallocated in the caller's scratch.
+ */
+static int shift_select_group(ShiftSelection *sel,
+                              long long *left_bounds, long long *right_bounds,
+                              long long active_set_size, long long count_below_active,
+                              double active_min, double active_max,
+                              const long long *ranks, int n_ranks, double *out, int depth) {
+    int n_rows = sel->n_rows;
+    int n_cols = sel->n_cols;
+    int weak_passes = 0;
+    int stall_count = 0;
+    const int max_stall = 8;
+
+    // Latest two (value, rank) probes, seeded with the ends of the active set
+    double probe_pivot[2] = { active_max, active_min };
+    double probe_rank[2] = {
+        (double)(count_below_active + active_set_size),
+        (double)count_below_active
+    };
+
+    while (n_ranks > 0) {
+        if (active_set_size == 0) return SHIFT_NO_CONVERGENCE;
+
+        // Every remaining cell holds the same value
+        if (active_min == active_max) {
+            for (int i = 0; i < n_ranks; i++) out[i] = active_min;
+            return SHIFT_OK;
+        }
+
+        if (sel->iterations_left-- <= 0) return SHIFT_NO_CONVERGENCE;
+        int stop = kernel_budget_poll(sel->budget);
+        if (stop) return stop;
+        KERNEL_STATS_ADD(sel->stats, passes, 1);
+        KERNEL_STATS_ADD(sel->stats, sweeps, 1);
+
+        double pivot;
+        if (weak_passes >= 2) {
+            KERNEL_STATS_ADD(sel->stats, fallback_pivots, 1);
+            pivot = shift_median_pivot(sel, left_bounds, right_bounds, active_set_size);
+        } else {
+            double target = (double)ranks[n_ranks / 2] - 0.5;
+            pivot = NAN;
+            if (probe_rank[0] != probe_rank[1]) {
+                // Secant through the two latest probes
+                pivot = probe_pivot[1] + (target - probe_rank[1]) *
+                    ((probe_pivot[1] - probe_pivot[0]) / (probe_rank[1] - probe_rank[0]));
+            }
+            if (!(pivot >= active_min && pivot < active_max)) {
+                // Interpolate on the active set itself
+                double fraction = (target - (double)count_below_active) / (double)active_set_size;
+                pivot = (1.0 - fraction) * active_min + fraction * active_max;
+            }
+            // Any threshold in [active_min, active_max) discards at least one cell
+            if (!(pivot >= active_min && pivot < active_max)) {
+                pivot = active_min;
+            }
+        }
+
+        /* === PARTITION STEP === */
+        long long count_below = 0;
+        long long count_at_or_below = 0;
+        long long column_below = n_cols - 1;
+        long long column_at_or_below = n_cols - 1;
+        double closest_below = -INFINITY;
+        double closest_above = INFINITY;
+
+        for (int row = 0; row < n_rows; row++) {
+            // Column c lives at cols[n_cols - 1 - c], so walking c down walks
+            // the cols array up
+            double row_value = sel->rows[row];
+            column_at_or_below = n_cols - 1 -
+                count_advance_gt(sel->cols, (int)(n_cols - 1 - column_at_or_below), n_cols, row_value, pivot);
+            // Cells below the pivot are a prefix of those at or below it, so
+            // this pointer only ever walks over ties
+            column_below = MIN(column_below, column_at_or_below);
+            column_below = n_cols - 1 -
+                count_advance_ge(sel->cols, (int)(n_cols - 1 - column_below), n_cols, row_value, pivot);
+
+            sel->below_counts[row] = column_below + 1;
+            sel->at_or_below_counts[row] = column_at_or_below + 1;
+            count_below += column_below + 1;
+            count_at_or_below += column_at_or_below + 1;
+
+            if (column_below >= 0) {
+                closest_below = MAX(closest_below, shift_diff(sel, row, column_below));
+            }
+            if (column_at_or_below < n_cols - 1) {
+                closest_above = MIN(closest_above, shift_diff(sel, row, column_at_or_below + 1));
+            }
+        }
+
+        /* === TARGET CHECK: split the ranks around the pivot === */
+        int below_end = 0;
+        while (below_end < n_ranks && ranks[below_end] <= count_below) below_end++;
+        int at_end = below_end;
+        while (at_end < n_ranks && ranks[at_end] <= count_at_or_below) {
+            out[at_end++] = pivot;
+        }
+
+        int n_below = below_end;
+        int n_above = n_ranks - at_end;
+        if (n_below == 0 && n_above == 0) return SHIFT_OK;
+
+        long long previous_active_set_size = active_set_size;
+
+        /* === DIVERGENCE: hand the smaller group a private copy of the bounds === */
+        if (n_below > 0 && n_above > 0) {
+            long long *copy_left = sel->copies + 2 * (size_t)n_rows * depth;
+            long long *copy_right = copy_left + n_rows;
+            memcpy(copy_left, left_bounds, n_rows * sizeof(long long));
+            memcpy(copy_right, right_bounds, n_rows * sizeof(long long));
+
+            int status;
+            if (n_below <= n_above) {
+                long long copy_size = shift_keep_below(n_rows, copy_left, copy_right, sel->below_counts);
+                status = shift_select_group(sel, copy_left, copy_right, copy_size, count_below_active,
+                                            active_min, closest_below, ranks, n_below, out, depth + 1);
+                active_set_size = shift_keep_above(n_rows, left_bounds, right_bounds, sel->at_or_below_counts);
+                count_below_active = count_at_or_below;
+                active_min = closest_above;
+                ranks += at_end;
+                out += at_end;
+                n_ranks = n_above;
+            } else {
+                long long copy_size = shift_keep_above(n_rows, copy_left, copy_right, sel->at_or_below_counts);
+                status = shift_select_group(sel, copy_left, copy_right, copy_size, count_at_or_below,
+                                            closest_above, active_max, ranks + at_end, n_above, out + at_end,
+                                            depth + 1);
+                active_set_size = shift_keep_below(n_rows, left_bounds, right_bounds, sel->below_counts);
+                active_max = closest_below;
+                n_ranks = n_below;
+            }
+            if (status != SHIFT_OK) return status;
+        } else if (n_below > 0) {
+            active_set_size = shift_keep_below(n_rows, left_bounds, right_bounds, sel->below_counts);
+            active_max = closest_below;
+            n_ranks = n_below;
+        } else {
+            active_set_size = shift_keep_above(n_rows, left_bounds, right_bounds, sel->at_or_below_counts);
+            count_below_active = count_at_or_below;
+            active_min = closest_above;
+            ranks += at_end;
+            out += at_end;
+            n_ranks = n_above;
+        }
+
+        /* === PREPARE NEXT ITERATION === */
+        probe_pivot[0] = probe_pivot[1];
+        probe_rank[0] = probe_rank[1];
+        probe_pivot[1] = pivot;
+        probe_rank[1] = 0.5 * (double)count_below + 0.5 * (double)count_at_or_below;
+        if (active_set_size > previous_active_set_size - previous_active_set_size / 4) {
+            weak_passes++;
+        } else {
+            weak_passes = 0;
+        }
+
+        /*
+         * A non-shrinking active set only happens on pathological input
+         * (e.g., assume_sorted=TRUE on unsorted data); bail out deterministically.
+         */
+        if (active_set_size >= previous_active_set_size) {
+            KERNEL_STATS_ADD(sel->stats, stall_passes, 1);
+            if (++stall_count >= max_stall) return SHIFT_NO_CONVERGENCE;
+        } else {
+            stall_count = 0;
         }
     }
 
-    int assume_sorted = asLogical(assume_sorted_sexp);
+    return SHIFT_OK;
+}
 
-    // Prepare sorted arrays
-    double *xs = (double *) R_alloc(m, sizeof(double));
-    double *ys = (double *) R_alloc(n, sizeof(double));
+/*
+ * Core multi-rank selection over the m*n pairwise differences; see
+ * shift_select_group. Rows are the shorter sample, so the working memory is
+ * O(min(m, n)) while every pass costs O(m + n). When y is the shorter sample
+ * the ranks are mirrored onto the differences y[j] - x[i] and negated back.
+ * The per-row arrays and the bounds copies live in the caller's `work`
+ * (layout as in shift_work_size); never raises an R error. Work is counted into `stats` and every pass polls
+ * `budget`, unless NULL.
+ */
+static int shift_ranks_select(const double *x, int m, const double *y, int n,
+                              const long long *ranks, int n_ranks, double *out,
+                              void *work_block, KernelStats *stats, KernelBudget *budget) {
+    if (n_ranks == 0) return SHIFT_OK;
 
-    double *x_vals = REAL(x_sexp);
-    double *y_vals = REAL(y_sexp);
+    int mirrored = m > n;
+    int n_rows = mirrored ? n : m;
+    long long total = (long long)m * n;
 
-    for (int i = 0; i < m; i++) xs[i] = x_vals[i];
-    for (int i = 0; i < n; i++) ys[i] = y_vals[i];
+    char *work = (char *)work_block;
+    size_t row_bytes = (size_t)n_rows * (4 * sizeof(long long) + sizeof(WeightedValue));
+    size_t mirror_bytes = mirrored ? (size_t)n_ranks * (sizeof(long long) + sizeof(double)) : 0;
+
+    long long *left_bounds = (long long *)work;
+    long long *right_bounds = left_bounds + n_rows;
+
+    ShiftSelection sel;
+    sel.rows = mirrored ? y : x;
+    sel.n_rows = n_rows;
+    sel.cols = mirrored ? x : y;
+    sel.n_cols = mirrored ? m : n;
+    sel.below_counts = right_bounds + n_rows;
+    sel.at_or_below_counts = sel.below_counts + n_rows;
+    sel.candidates = (WeightedValue *)(sel.at_or_below_counts + n_rows);
+    sel.copies = (long long *)(work + row_bytes + mirror_bytes);
+    sel.stats = stats;
+    sel.budget = budget;
+
+    /*
+     * Bound the selection loop. On valid sorted input every rank group
+     * converges in O(log(mn)) passes; like center_impl's cap this only
+     * guarantees termination on misuse (assume_sorted=TRUE on UNSORTED input).
+     */
+    const long long base_iterations = 256;
+    sel.iterations_left = (base_iterations + 4LL * (m + n)) * n_ranks;
+
+    for (int row = 0; row < n_rows; row++) {
+        left_bounds[row] = 0;
+        right_bounds[row] = sel.n_cols - 1;
+    }
 
-    if (!assume_sorted) {
-        R_rsort(xs, m);
-        R_rsort(ys, n);
+    int status;
+    if (!mirrored) {
+        status = shift_select_group(&sel, left_bounds, right_bounds, total, 0,
+                                    x[0] - y[n - 1], x[m - 1] - y[0], ranks, n_ranks, out, 0);
+    } else {
+        long long *mirror_ranks = (long long *)(work + row_bytes);
+        double *mirror_out = (double *)(mirror_ranks + n_ranks);
+        for (int i = 0; i < n_ranks; i++) {
+            mirror_ranks[i] = total + 1 - ranks[n_ranks - 1 - i];
+        }
+        status = shift_select_group(&sel, left_bounds, right_bounds, total, 0,
+                                    y[0] - x[m - 1], y[n - 1] - x[0], mirror_ranks, n_ranks, mirror_out, 0);
+        // 0.0 - v (rather than -v) keeps zero differences at +0.0
+        for (int i = 0; i < n_ranks; i++) {
+            out[i] = 0.0 - mirror_out[n_ranks - 1 - i];
+        }
     }
 
+    return status;
+}
+
+int shift_ranks_compute_ws(const double *x, int m, const double *y, int n,
+                           const long long *ranks, int n_ranks, double *out,
+                           void *work_block, KernelBudget *budget) {
+    return shift_ranks_select(x, m, y, n, ranks, n_ranks, out, work_block, NULL, budget);
+}
+
+/*
+ * Scratch layout: the per-row arrays, the mirrored ranks and values when y is
+ * the shorter sample, then one pair of bounds copies per divergence level
+ * (floor(log2(n_ranks)) of them, as in center_work_size).
+ */
+size_t shift_work_size(int m, int n, int n_ranks) {
+    int n_rows = m > n ? n : m;
+    int levels = 0;
+    for (int groups = n_ranks; groups > 1; groups >>= 1) levels++;
+    size_t row_bytes = (size_t)n_rows * (4 * sizeof(long long) + sizeof(WeightedValue));
+    size_t mirror_bytes = m > n ? (size_t)n_ranks * (sizeof(long long) + sizeof(double)) : 0;
+    size_t copy_bytes = 2 * (size_t)levels * n_rows * sizeof(long long);
+    return row_bytes + mirror_bytes + copy_bytes;
+}
+
+/*
+ * shift_ranks_select with its own working memory; one block for the
+ * per-row arrays keeps the error paths simple.
+ */
+static int shift_ranks_run(const double *x, int m, const double *y, int n,
+                           const long long *ranks, int n_ranks, double *out, KernelStats *stats,
+                           KernelBudget *budget) {
+    if (n_ranks == 0) return SHIFT_OK;
+
+    void *work = malloc(shift_work_size(m, n, n_ranks));
+    if (!work) return SHIFT_NO_MEMORY;
+    int status = shift_ranks_select(x, m, y, n, ranks, n_ranks, out, work, stats, budget);
+    free(work);
+    return status;
+}
+
+int shift_ranks_compute(const double *x, int m, const double *y, int n,
+                        const long long *ranks, int n_ranks, double *out) {
+    return shift_ranks_run(x, m, y, n, ranks, n_ranks, out, NULL, NULL);
+}
+
+/*
+ * Type-7 quantiles at `p` of the differences of sorted x and y into `out`:
+ * the body of shift_impl_c once its inputs are validated and sorted. The
+ * ranks are selected over the doubles xs and ys, or over `ints` (then xs and
+ * ys are NULL) by its count sweeps.
+ */
+static void shift_quantiles_run(const double *xs, int m, const double *ys, int n,
+                                const SweepPairs *ints, const double *p, int np, int use_bisection,
+                                double *out, KernelStats *stats, KernelBudget *budget) {
     long long total = (long long)m * n;
 
     // Compute Type-7 quantile parameters for each probability
@@ -187,9 +663,8 @@ SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp
 
     QuantileParams *params = (QuantileParams *) R_alloc(np, sizeof(QuantileParams));
 
-    // Track unique ranks we need to compute
-    int *required_ranks = (int *) R_alloc(2 * np, sizeof(int));
-    double *rank_values = (double *) R_alloc(2 * np, sizeof(double));
+    // Collect every rank we need; sorted and deduplicated below
+    long long *required_ranks = (long long *) R_alloc(2 * np, sizeof(long long));
     int n_ranks = 0;
 
     for (int i = 0; i < np; i++) {
@@ -206,44 +681,247 @@ SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp
         params[i].upper_rank = upper_rank;
         params[i].weight = weight;
 
-        // Add to required ranks if not already present
-        int found_lower = 0, found_upper = 0;
-        for (int j = 0; j < n_ranks; j++) {
-            if (required_ranks[j] == lower_rank) found_lower = 1;
-            if (required_ranks[j] == upper_rank) found_upper = 1;
+        required_ranks[n_ranks++] = lower_rank;
+        required_ranks[n_ranks++] = upper_rank;
+    }
+
+    qsort(required_ranks, n_ranks, sizeof(long long), cmp_rank);
+    int n_unique = 0;
+    for (int i = 0; i < n_ranks; i++) {
+        if (n_unique == 0 || required_ranks[n_unique - 1] != required_ranks[i]) {
+            required_ranks[n_unique++] = required_ranks[i];
+        }
+    }
+    n_ranks = n_unique;
+
+    if (xs && (ISNAN(xs[0] - ys[n - 1]) || ISNAN(xs[m - 1] - ys[0]))) {
+        error("NaN in input values");
+    }
+
+    double *rank_values = (double *) R_alloc(n_ranks, sizeof(double));
+    if (ints) {
+        // Heavily tied ints go to the tie compression, which promotes only
+        // the distinct values
+        int runs_x = m + n >= TIES_MIN_SIZE ? sorted_int_runs(ints->x, m) : m;
+        int runs_y = m + n >= TIES_MIN_SIZE ? sorted_int_runs(ints->y, n) : n;
+        int status;
+        if (ties_compressible(m + n, runs_x + runs_y)) {
+            if (stats) stats->ties_compressed = 1;
+            void *work = r_scratch_reserve(ties_shift_work_size(runs_x, runs_y));
+            status = ties_shift_ranks_ws(ints->x, m, runs_x, ints->y, n, runs_y, 1, required_ranks,
+                                         n_ranks, work, rank_values, stats, budget);
+            r_scratch_trim();
+        } else {
+            status = sweep_ranks_compute(ints, required_ranks, n_ranks, rank_values, stats, budget);
+        }
+        if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+        if (status != SWEEP_OK) {
+            error("Convergence failure (pathological input)");
         }
-        if (!found_lower) {
-            required_ranks[n_ranks++] = lower_rank;
+    } else if (use_bisection) {
+        /*
+         * Compute values for required ranks in ascending order. Every search logs
+         * its probes, so each later (larger) rank starts from the tightest bracket
+         * found so far instead of the full [min, max] difference range; nearby
+         * ranks such as the two shift_bounds margins then need only a few sweeps.
+         */
+        SearchLog log;
+        log.capacity = 128 * n_ranks;
+        log.size = 0;
+        log.probes = (SearchProbe *) R_alloc(log.capacity, sizeof(SearchProbe));
+
+        for (int i = 0; i < n_ranks; i++) {
+            rank_values[i] = select_kth_pairwise_diff(xs, m, ys, n, required_ranks[i], &log, stats,
+                                                      budget);
         }
-        if (!found_upper && upper_rank != lower_rank) {
-            required_ranks[n_ranks++] = upper_rank;
+    } else {
+        // Heavily tied input: select over the distinct values (same result, and
+        // the weighted search terminates on any finite input; the WEIGHTED_*
+        // status codes coincide with SHIFT_*)
+        int runs_x = m + n >= TIES_MIN_SIZE ? sorted_runs(xs, m) : m;
+        int runs_y = m + n >= TIES_MIN_SIZE ? sorted_runs(ys, n) : n;
+        int status;
+        if (ties_compressible(m + n, runs_x + runs_y)) {
+            if (stats) stats->ties_compressed = 1;
+            void *work = r_scratch_reserve(ties_shift_work_size(runs_x, runs_y));
+            status = ties_shift_ranks_ws(xs, m, runs_x, ys, n, runs_y, 0, required_ranks, n_ranks,
+                                         work, rank_values, stats, budget);
+            r_scratch_trim();
+        } else {
+            status = shift_ranks_run(xs, m, ys, n, required_ranks, n_ranks, rank_values, stats, budget);
+        }
+        if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+        if (status == SHIFT_NO_MEMORY) {
+            error("shift_impl: memory allocation failed");
+        }
+        if (status != SHIFT_OK) {
+            error("Convergence failure (pathological input)");
         }
     }
 
-    // Compute values for required ranks
-    for (int i = 0; i < n_ranks; i++) {
-        rank_values[i] = select_kth_pairwise_diff(xs, m, ys, n, required_ranks[i]);
+    // Interpolate to get final quantiles
+    for (int i = 0; i < np; i++) {
+        double weight = params[i].weight;
+        double lower_val = rank_values[find_rank(required_ranks, n_ranks, params[i].lower_rank)];
+        double upper_val = rank_values[find_rank(required_ranks, n_ranks, params[i].upper_rank)];
+
+        out[i] = (weight == 0.0) ? lower_val : (1.0 - weight) * lower_val + weight * upper_val;
     }
+}
 
-    // Interpolate to get final quantiles
-    SEXP result = PROTECT(allocVector(REALSXP, np));
-    double *result_ptr = REAL(result);
+void shift_quantiles_compute(const double *xs, int m, const double *ys, int n,
+                             const double *p, int np, int use_bisection, double *out,
+                             KernelStats *stats, KernelBudget *budget) {
+    shift_quantiles_run(xs, m, ys, n, NULL, p, np, use_bisection, out, stats, budget);
+}
+
+void shift_quantiles_compute_ints(const int *xs, int m, const int *ys, int n,
+                                  const double *p, int np, double *out,
+                                  KernelStats *stats, KernelBudget *budget) {
+    SweepPairs pairs = { SWEEP_SHIFT, 1, xs, m, ys, n, 1 };
+    shift_quantiles_run(NULL, m, NULL, n, &pairs, p, np, 0, out, stats, budget);
+}
+
+/*
+ * Computes quantiles of all pairwise differences { x_i - y_j }.
+ * Time: O((m + n) * log(mn)) per quantile with the default rank-based
+ * selection, O((m + n) * log(precision)) with value bisection.
+ * Space: O(min(m, n)) and O(1) respectively, plus sorted copies of x and y
+ * unless assume_sorted (sorted input is read in place, never copied).
+ *
+ * @param x_sexp Numeric vector (a sorted copy is made if needed)
+ * @param y_sexp Numeric vector (a sorted copy is made if needed)
+ * @param p_sexp Numeric vector of probabilities in [0, 1]
+ * @param assume_sorted_sexp Logical: if TRUE, assume x and y are already sorted
+ * @param method_sexp Selection mode: "rank" (default) or "bisection"
+ * @param diagnostics_sexp Logical: if TRUE, attach the selection's work
+ *   counters and timings as the "diagnostics" attribute (see kernel_stats.h)
+ * @param deadline_sexp Deadline of the selection, which also polls for user
+ *   interrupts (see kernel_budget.h)
+ * @return Numeric vector of quantile values
+ */
+SEXP shift_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP p_sexp, SEXP assume_sorted_sexp, SEXP method_sexp,
+                  SEXP diagnostics_sexp, SEXP deadline_sexp) {
+    // Input validation
+    if (!(isReal(x_sexp) || isInteger(x_sexp)) || !(isReal(y_sexp) || isInteger(y_sexp)) ||
+        !isReal(p_sexp)) {
+        error("x, y, and p must be numeric vectors");
+    }
+    if (!isLogical(assume_sorted_sexp)) {
+        error("assume_sorted must be logical");
+    }
+    if (!isString(method_sexp) || length(method_sexp) != 1) {
+        error("method must be a single string");
+    }
+    const char *method = CHAR(STRING_ELT(method_sexp, 0));
+    int use_bisection = strcmp(method, "bisection") == 0;
+    if (!use_bisection && strcmp(method, "rank") != 0) {
+        error("method must be \"rank\" or \"bisection\"");
+    }
+
+    int m = length(x_sexp);
+    int n = length(y_sexp);
+    int np = length(p_sexp);
+
+    if (m == 0 || n == 0) {
+        error("x and y must be non-empty");
+    }
 
+    const double *p = REAL(p_sexp);
     for (int i = 0; i < np; i++) {
-        long long lower_rank = params[i].lower_rank;
-        long long upper_rank = params[i].upper_rank;
-        double weight = params[i].weight;
+        if (ISNAN(p[i]) || p[i] < 0.0 || p[i] > 1.0) {
+            error("Probabilities must be within [0, 1]");
+        }
+    }
 
-        // Find values for lower and upper ranks
-        double lower_val = 0.0, upper_val = 0.0;
-        for (int j = 0; j < n_ranks; j++) {
-            if (required_ranks[j] == lower_rank) lower_val = rank_values[j];
-            if (required_ranks[j] == upper_rank) upper_val = rank_values[j];
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    KernelStats record = { 0 };
+    KernelStats *stats = asLogical(diagnostics_sexp) == TRUE ? &record : NULL;
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    double mark = stats ? kernel_clock() : 0;
+
+    // Read sorted input in place (strictly read-only); integer input arrives
+    // as sorted ints, other unsorted input is sorted into copies
+    int x_sorted = assume_sorted;
+    int y_sorted = assume_sorted;
+    int x_int, y_int;
+    const void *x_values = native_input(x_sexp, &x_sorted, &x_int);
+    const void *y_values = native_input(y_sexp, &y_sorted, &y_int);
+
+    // Two integer samples are selected as ints; with one only, it is promoted
+    SEXP result = PROTECT(allocVector(REALSXP, np));
+    if (x_int && y_int) {
+        KERNEL_STATS_LAP(stats, sort_seconds, mark);
+        shift_quantiles_compute_ints(x_values, m, y_values, n, p, np, REAL(result), stats, &budget);
+    } else {
+        const double *xs = native_input_doubles(x_values, m, x_int);
+        const double *ys = native_input_doubles(y_values, n, y_int);
+        if (!x_sorted || !y_sorted) {
+            void *sort_work = r_scratch_reserve(sort_work_size(m > n ? m : n));
+            if (!x_sorted) {
+                double *x_copy = (double *) R_alloc(m, sizeof(double));
+                memcpy(x_copy, xs, m * sizeof(double));
+                sort_doubles(x_copy, m, sort_work);
+                xs = x_copy;
+            }
+            if (!y_sorted) {
+                double *y_copy = (double *) R_alloc(n, sizeof(double));
+                memcpy(y_copy, ys, n * sizeof(double));
+                sort_doubles(y_copy, n, sort_work);
+                ys = y_copy;
+            }
+            r_scratch_trim();
         }
+        KERNEL_STATS_LAP(stats, sort_seconds, mark);
+        shift_quantiles_compute(xs, m, ys, n, p, np, use_bisection, REAL(result), stats, &budget);
+    }
+    KERNEL_STATS_LAP(stats, select_seconds, mark);
+    if (stats) kernel_stats_attach(result, stats);
+    UNPROTECT(1);
+    return result;
+}
+
+/*
+ * Counts of the pairwise differences x[i] - y[j] of sorted NaN-free x and y
+ * strictly below and at or below `threshold`, as c(below, at_or_below), in one
+ * two-pointer sweep (the sweep of count_and_neighbors). With exp_sexp TRUE the
+ * differences are compared as exp(x[i] - y[j]), for Ratio over log values.
+ * The difference of 1-based rank k then exceeds the threshold iff
+ * at_or_below < k, and lies below it iff below >= k.
+ */
+SEXP shift_count_impl_c(SEXP x_sexp, SEXP y_sexp, SEXP threshold_sexp, SEXP exp_sexp) {
+    if (!isReal(x_sexp) || !isReal(y_sexp) || !isReal(threshold_sexp) ||
+        length(threshold_sexp) != 1) {
+        error("x, y and threshold must be numeric");
+    }
+    const double *x = REAL(x_sexp);
+    const double *y = REAL(y_sexp);
+    int m = length(x_sexp);
+    int n = length(y_sexp);
+    double threshold = REAL(threshold_sexp)[0];
+    int use_exp = asLogical(exp_sexp) == TRUE;
 
-        result_ptr[i] = (weight == 0.0) ? lower_val : (1.0 - weight) * lower_val + weight * upper_val;
+    long long below = 0;
+    long long at_or_below = 0;
+    int j_below = 0;
+    int j_at_or_below = 0;
+    for (int i = 0; i < m; i++) {
+        // First columns whose difference is below (resp. at or below) the threshold
+        if (use_exp) {
+            while (j_below < n && exp(x[i] - y[j_below]) >= threshold) j_below++;
+            while (j_at_or_below < n && exp(x[i] - y[j_at_or_below]) > threshold) j_at_or_below++;
+        } else {
+            j_below = count_advance_ge(y, j_below, n, x[i], threshold);
+            j_at_or_below = count_advance_gt(y, j_at_or_below, n, x[i], threshold);
+        }
+        below += n - j_below;
+        at_or_below += n - j_at_or_below;
     }
 
+    SEXP result = PROTECT(allocVector(REALSXP, 2));
+    REAL(result)[0] = (double)below;
+    REAL(result)[1] = (double)at_or_below;
     UNPROTECT(1);
     return result;
 }
@@ -0,0 +1,57 @@
+#ifndef SHIFT_IMPL_H
+#define SHIFT_IMPL_H
+
+#include <stddef.h>
+#include "kernel_stats.h"
+#include "kernel_budget.h"
+
+/* Status codes of shift_ranks_compute */
+#define SHIFT_OK 0
+#define SHIFT_NO_MEMORY 1
+#define SHIFT_NO_CONVERGENCE 2
+
+/*
+ * Select several order statistics of the m*n pairwise differences
+ * x[i] - y[j] in one shared rank-based selection: out[i] receives the
+ * difference of 1-based rank ranks[i]. `x` and `y` must be sorted ascending
+ * and free of NaN, and `ranks` ascending (duplicates allowed) within [1, m*n].
+ * Never raises an R error; returns SHIFT_OK or a failure status.
+ */
+int shift_ranks_compute(const double *x, int m, const double *y, int n,
+                        const long long *ranks, int n_ranks, double *out);
+
+/* Scratch bytes shift_ranks_compute_ws needs for n_ranks ranks of x (m), y (n) */
+size_t shift_work_size(int m, int n, int n_ranks);
+
+/*
+ * shift_ranks_compute with caller-provided scratch of at least
+ * shift_work_size(m, n, n_ranks) bytes, suitably aligned for double and
+ * long long (e.g. from malloc or R_alloc). Lets batched callers reuse one
+ * buffer across many samples. Every pass polls `budget` unless NULL,
+ * returning its stopped status once it runs out (see kernel_budget.h).
+ */
+int shift_ranks_compute_ws(const double *x, int m, const double *y, int n,
+                           const long long *ranks, int n_ranks, double *out,
+                           void *work, KernelBudget *budget);
+
+/*
+ * Type-7 quantiles at probabilities p[0..np) (within [0, 1]) of the m*n
+ * differences of sorted x and y into out[0..np). Selects by rank, or by value
+ * bisection when use_bisection. Raises an R error on NaN differences and on
+ * selection failure, and once `budget` runs out. Work is counted into `stats`
+ * and the selection polls `budget`, unless NULL.
+ */
+void shift_quantiles_compute(const double *xs, int m, const double *ys, int n,
+                             const double *p, int np, int use_bisection, double *out,
+                             KernelStats *stats, KernelBudget *budget);
+
+/*
+ * shift_quantiles_compute of sorted int samples, read in place: the ranks are
+ * selected by the constant-memory count sweeps of sweep_select.h over the
+ * promoted values, so the quantiles equal those of the double input.
+ */
+void shift_quantiles_compute_ints(const int *xs, int m, const int *ys, int n,
+                                  const double *p, int np, double *out,
+                                  KernelStats *stats, KernelBudget *budget);
+
+#endif
@@ -0,0 +1,73 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <limits.h>
+#include <math.h>
+
+/* log(exp(a) + exp(b)), with -Inf as the log of zero */
+static double log_add_exp(double a, double b) {
+    if (a == -INFINITY) return b;
+    if (b == -INFINITY) return a;
+    double m = a > b ? a : b;
+    return m + log(exp(a - m) + exp(b - m));
+}
+
+/*
+ * Walks the Binomial(n, 1/2) CDF in log space up to `log_target`.
+ *
+ * Stores r_low, the largest r with P(X <= r) <= target (0 if even P(X = 0)
+ * exceeds it), log P(X <= r_low) and log P(X = r_low + 1) (-Inf when
+ * r_low = n) in `out`. The pmf follows the ratio recurrence and the CDF is
+ * accumulated term by term with the same operations, in the same order, as
+ * the R implementation it replaces, so the split is bit-identical to it.
+ * Touches no R API.
+ */
+static void binom_cdf_split_compute(double n, double log_target, double *out) {
+    double log_pmf = -n * log(2.0);
+    double log_cdf = log_pmf;
+    double r_low = 0;
+
+    out[0] = 0;
+    out[1] = log_cdf;
+    out[2] = log_pmf;
+    if (log_cdf > log_target) {
+        return;
+    }
+
+    for (double k = 1; k <= n; k++) {
+        double log_pmf_next = log_pmf + log(n - k + 1) - log(k);
+        double log_cdf_next = log_add_exp(log_cdf, log_pmf_next);
+        if (log_cdf_next > log_target) {
+            out[0] = r_low;
+            out[1] = log_cdf;
+            out[2] = log_pmf_next;
+            return;
+        }
+        r_low = k;
+        log_pmf = log_pmf_next;
+        log_cdf = log_cdf_next;
+    }
+
+    out[0] = r_low;
+    out[1] = log_cdf;
+    out[2] = -INFINITY;
+}
+
+/*
+ * R entry point of binom_cdf_split: c(r_low, log_cdf_low, log_pmf_high) for
+ * Binomial(n, 1/2) and the tail probability `target`.
+ */
+SEXP binom_cdf_split_impl_c(SEXP n_sexp, SEXP target_sexp) {
+    double n = asReal(n_sexp);
+    double target = asReal(target_sexp);
+    if (ISNAN(n) || n < 1 || n != floor(n) || n > INT_MAX) {
+        error("n must be a positive integer");
+    }
+    if (ISNAN(target)) {
+        error("target must not be NaN");
+    }
+
+    SEXP result = PROTECT(allocVector(REALSXP, 3));
+    binom_cdf_split_compute(n, log(target), REAL(result));
+    UNPROTECT(1);
+    return result;
+}
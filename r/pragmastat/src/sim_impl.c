@@ -0,0 +1,390 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "center_impl.h"
+#include "spread_impl.h"
+#include "shift_impl.h"
+#include "kernel_budget.h"
+#include "rng_impl.h"
+#include "scratch_arena.h"
+#include "radix_sort.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#ifdef _OPENMP
+#define SIM_THREAD_NUM() omp_get_thread_num()
+#else
+#define SIM_THREAD_NUM() 0
+#endif
+
+/*
+ * Native simulation driver: draws `replicates` samples from one of the dist_*
+ * distributions (and optionally a second sample from another, for the
+ * two-sample estimators) and evaluates a set of estimators on each, so a
+ * sampling distribution costs one .Call instead of an interpreted loop over
+ * dist$samples() and the estimator calls.
+ *
+ * Replicate r (0-based) draws from its own generator, seeded with the base
+ * seed plus r: x first, then y, each value exactly as dist$sample() computes
+ * it. Replicates are therefore independent of one another and of the thread
+ * that runs them, and the result is bit-identical for any thread count.
+ *
+ * The workers share the replicates, each with a private slice of the R scratch
+ * arena holding its draws and the kernels' scratch, reused by every replicate
+ * it runs. The R API is only touched on the calling thread; kernel failures
+ * are recorded per replicate and raised after the loop.
+ *
+ * The workers share one budget of the call's deadline, polled before every
+ * replicate and inside its selections (thread 0 also checks for a user
+ * interrupt); once it stops, the remaining replicates are skipped and the
+ * stop is raised after the loop instead of a partial matrix.
+ */
+
+/* Distribution kinds, parsed from the dist_* native specs */
+enum {
+    SIM_ADDITIVE,
+    SIM_EXP,
+    SIM_MULTIPLIC,
+    SIM_POWER,
+    SIM_UNIFORM
+};
+
+/* Estimator codes, in the order of SIMULATE_ESTIMATORS in R/simulate.R */
+enum {
+    SIM_MEAN = 1,
+    SIM_MEDIAN,
+    SIM_SD,
+    SIM_MAD,
+    SIM_CENTER,
+    SIM_SPREAD,
+    SIM_SHIFT,
+    SIM_RATIO,
+    SIM_DISPARITY
+};
+
+/* Status codes of one replicate */
+#define SIM_OK 0
+#define SIM_NO_CONVERGENCE 2
+
+/* Smallest positive subnormal and machine epsilon, as in R/aaa_constants.R */
+#define SIM_SMALLEST_SUBNORMAL 4.9406564584124654e-324
+#define SIM_MACHINE_EPSILON 2.220446049250313e-16
+
+typedef struct {
+    int kind;
+    double a;
+    double b;
+} SimDist;
+
+static SimDist parse_dist(SEXP kind_sexp, SEXP params_sexp, const char *name) {
+    static const char *kinds[] = { "additive", "exp", "multiplic", "power", "uniform" };
+    if (!isString(kind_sexp) || length(kind_sexp) != 1 || !isReal(params_sexp) || length(params_sexp) != 2) {
+        error("%s must be a distribution created by a dist_* function", name);
+    }
+    const char *kind = CHAR(STRING_ELT(kind_sexp, 0));
+    for (int i = 0; i < (int)(sizeof(kinds) / sizeof(kinds[0])); i++) {
+        if (strcmp(kind, kinds[i]) == 0) {
+            SimDist dist = { i, REAL(params_sexp)[0], REAL(params_sexp)[1] };
+            return dist;
+        }
+    }
+    error("unknown distribution kind '%s'", kind);
+}
+
+/* R's x^y, which squares exactly for y == 2 */
+static inline double r_power(double x, double y) {
+    return y == 2.0 ? x * x : pow(x, y);
+}
+
+/* First Box-Muller output, as dist_additive draws it */
+static inline double draw_additive(Xoshiro256 *rng, double mean, double std_dev) {
+    double u1 = xoshiro256_uniform_float(rng);
+    double u2 = xoshiro256_uniform_float(rng);
+    if (u1 == 0) u1 = SIM_SMALLEST_SUBNORMAL;
+    return mean + sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2) * std_dev;
+}
+
+static inline double draw_value(const SimDist *dist, Xoshiro256 *rng) {
+    double u;
+    switch (dist->kind) {
+    case SIM_ADDITIVE:
+        return draw_additive(rng, dist->a, dist->b);
+    case SIM_MULTIPLIC:
+        return exp(draw_additive(rng, dist->a, dist->b));
+    case SIM_EXP:
+        u = xoshiro256_uniform_float(rng);
+        if (u == 1.0) u = 1.0 - SIM_MACHINE_EPSILON;
+        return -log(1.0 - u) / dist->a;
+    case SIM_POWER:
+        u = xoshiro256_uniform_float(rng);
+        if (u == 1.0) u = 1.0 - SIM_MACHINE_EPSILON;
+        return dist->a / r_power(1.0 - u, 1.0 / dist->b);
+    default:
+        return dist->a + xoshiro256_uniform_float(rng) * (dist->b - dist->a);
+    }
+}
+
+/* R's mean(): a long double sum, refined by the mean residual */
+static double mean_of(const double *values, int n) {
+    long double sum = 0;
+    for (int i = 0; i < n; i++) sum += values[i];
+    sum /= n;
+    if (R_FINITE((double)sum)) {
+        long double residual = 0;
+        for (int i = 0; i < n; i++) residual += values[i] - sum;
+        sum += residual / n;
+    }
+    return (double)sum;
+}
+
+/* Bessel-corrected standard deviation; NA below two values */
+static double sd_of(const double *values, int n) {
+    if (n < 2) return NA_REAL;
+    double mean = mean_of(values, n);
+    long double sum = 0;
+    for (int i = 0; i < n; i++) sum += (values[i] - mean) * (values[i] - mean);
+    return sqrt((double)(sum / (n - 1)));
+}
+
+/* Median of sorted values; the even case averages the middle pair like R */
+static double median_of(const double *sorted_values, int n) {
+    if (n % 2 == 1) return sorted_values[n / 2];
+    return mean_of(sorted_values + n / 2 - 1, 2);
+}
+
+/*
+ * Median absolute deviation around the median (unscaled, i.e. R's
+ * mad(x, constant = 1)), with `buffer` of n doubles and `work` for the sort
+ */
+static double mad_of(const double *sorted_values, int n, double *buffer, void *work) {
+    double median = median_of(sorted_values, n);
+    for (int i = 0; i < n; i++) buffer[i] = fabs(sorted_values[i] - median);
+    sort_doubles(buffer, n, work);
+    return median_of(buffer, n);
+}
+
+/* Median of the m*n differences, as shift_impl_c computes it for p = 0.5 */
+static int shift_median(const double *xs, int m, const double *ys, int n, void *work,
+                        KernelBudget *budget, double *out) {
+    long long total = (long long)m * n;
+    long long ranks[2] = { (total + 1) / 2, (total + 2) / 2 };
+    int n_ranks = ranks[0] < ranks[1] ? 2 : 1;
+    double values[2];
+    int status = shift_ranks_compute_ws(xs, m, ys, n, ranks, n_ranks, values, work, budget);
+    *out = n_ranks == 2 ? 0.5 * values[0] + 0.5 * values[1] : values[0];
+    return status;
+}
+
+/* Center as center_impl_compute returns it, on sorted values */
+static int center_of(const double *sorted_values, int n, void *work, KernelBudget *budget, double *out) {
+    if (n == 1) {
+        *out = sorted_values[0];
+        return CENTER_OK;
+    }
+    if (n == 2) {
+        *out = 0.5 * sorted_values[0] + 0.5 * sorted_values[1];
+        return CENTER_OK;
+    }
+    return center_median_compute_ws(sorted_values, n, work, 1, out, budget);
+}
+
+/* Logs of sorted values into `buffer`; 0 if any value is not positive */
+static int log_sorted(const double *sorted_values, int n, double *buffer) {
+    if (sorted_values[0] <= 0) return 0;
+    for (int i = 0; i < n; i++) buffer[i] = log(sorted_values[i]);
+    return 1;
+}
+
+/* Per-replicate buffers: the two draws, two auxiliary arrays and the kernels' scratch */
+typedef struct {
+    double *x;
+    double *y;
+    double *aux_x;
+    double *aux_y;
+    void *work;
+} SimSlice;
+
+/*
+ * Evaluates `n_estimators` estimators on one replicate into out[k * stride].
+ * An estimator whose assumptions the draw violates (spread <= 0, non-positive
+ * values for Ratio) gets NA. Returns SIM_OK or SIM_NO_CONVERGENCE, which also
+ * covers a selection stopped by `budget` (the caller checks budget->stop).
+ */
+static int simulate_replicate(const SimDist *x_dist, const SimDist *y_dist, int n, int m,
+                              Xoshiro256 *rng, const int *estimators, int n_estimators,
+                              SimSlice *slice, KernelBudget *budget, double *out, R_xlen_t stride) {
+    for (int i = 0; i < n; i++) slice->x[i] = draw_value(x_dist, rng);
+    if (y_dist) {
+        for (int j = 0; j < m; j++) slice->y[j] = draw_value(y_dist, rng);
+    }
+
+    // Mean and SD read the draws in generation order, as R's mean() and sd() do
+    for (int k = 0; k < n_estimators; k++) {
+        if (estimators[k] == SIM_MEAN) out[k * stride] = mean_of(slice->x, n);
+        if (estimators[k] == SIM_SD) out[k * stride] = sd_of(slice->x, n);
+    }
+    sort_doubles(slice->x, n, slice->work);
+    if (y_dist) sort_doubles(slice->y, m, slice->work);
+
+    // Spreads are shared by Spread and Disparity, computed at most once each
+    double spread_x = NAN, spread_y = NAN;
+    for (int k = 0; k < n_estimators; k++) {
+        double *value = &out[k * stride];
+        int status = SIM_OK;
+        switch (estimators[k]) {
+        case SIM_MEDIAN:
+            *value = median_of(slice->x, n);
+            break;
+        case SIM_MAD:
+            *value = mad_of(slice->x, n, slice->aux_x, slice->work);
+            break;
+        case SIM_CENTER:
+            status = center_of(slice->x, n, slice->work, budget, value);
+            break;
+        case SIM_SPREAD:
+        case SIM_DISPARITY:
+            if (ISNAN(spread_x) && spread_median_compute(slice->x, n, slice->work, 1, &spread_x, budget) != SPREAD_OK) {
+                return SIM_NO_CONVERGENCE;
+            }
+            if (estimators[k] == SIM_SPREAD) {
+                *value = spread_x > 0 ? spread_x : NA_REAL;
+                break;
+            }
+            if (ISNAN(spread_y) && spread_median_compute(slice->y, m, slice->work, 1, &spread_y, budget) != SPREAD_OK) {
+                return SIM_NO_CONVERGENCE;
+            }
+            if (spread_x <= 0 || spread_y <= 0) {
+                *value = NA_REAL;
+                break;
+            }
+            status = shift_median(slice->x, n, slice->y, m, slice->work, budget, value);
+            *value /= ((double)n * spread_x + (double)m * spread_y) / (n + m);
+            break;
+        case SIM_SHIFT:
+            status = shift_median(slice->x, n, slice->y, m, slice->work, budget, value);
+            break;
+        case SIM_RATIO:
+            if (!log_sorted(slice->x, n, slice->aux_x) || !log_sorted(slice->y, m, slice->aux_y)) {
+                *value = NA_REAL;
+                break;
+            }
+            status = shift_median(slice->aux_x, n, slice->aux_y, m, slice->work, budget, value);
+            *value = exp(*value);
+            break;
+        }
+        if (status != SIM_OK) return SIM_NO_CONVERGENCE;
+    }
+    return SIM_OK;
+}
+
+/*
+ * Sampling distributions of estimators over simulated samples.
+ *
+ * @param x_kind_sexp, x_params_sexp Native spec of the x distribution
+ * @param y_kind_sexp, y_params_sexp Native spec of the y distribution, or NULL
+ *   when no two-sample estimator is requested
+ * @param n_sexp, m_sexp Integer: sizes of the x and y samples
+ * @param replicates_sexp Integer: number of replicates
+ * @param estimators_sexp Integer vector of estimator codes
+ * @param seed_sexp String or finite number: seed of the first replicate
+ * @param threads_sexp Integer: number of worker threads
+ * @param deadline_sexp Numeric: deadline of the call (see kernel_budget.h)
+ * @return Numeric matrix with one row per replicate and one column per estimator
+ */
+SEXP simulate_impl_c(SEXP x_kind_sexp, SEXP x_params_sexp, SEXP y_kind_sexp, SEXP y_params_sexp,
+                     SEXP n_sexp, SEXP m_sexp, SEXP replicates_sexp, SEXP estimators_sexp,
+                     SEXP seed_sexp, SEXP threads_sexp, SEXP deadline_sexp) {
+    SimDist x_dist = parse_dist(x_kind_sexp, x_params_sexp, "x_dist");
+    SimDist y_storage;
+    const SimDist *y_dist = NULL;
+    if (!isNull(y_kind_sexp)) {
+        y_storage = parse_dist(y_kind_sexp, y_params_sexp, "y_dist");
+        y_dist = &y_storage;
+    }
+
+    int n = asInteger(n_sexp);
+    int m = y_dist ? asInteger(m_sexp) : 0;
+    int replicates = asInteger(replicates_sexp);
+    if (n == NA_INTEGER || n < 1 || (y_dist && (m == NA_INTEGER || m < 1))) {
+        error("sample sizes must be positive integers");
+    }
+    if (replicates == NA_INTEGER || replicates < 1) {
+        error("replicates must be a positive integer");
+    }
+    if (!isInteger(estimators_sexp)) {
+        error("estimators must be an integer vector of estimator codes");
+    }
+    int n_estimators = length(estimators_sexp);
+    const int *estimators = INTEGER(estimators_sexp);
+    for (int k = 0; k < n_estimators; k++) {
+        if (estimators[k] < SIM_MEAN || estimators[k] > SIM_DISPARITY) {
+            error("unknown estimator code %d", estimators[k]);
+        }
+        if (estimators[k] >= SIM_SHIFT && !y_dist) {
+            error("two-sample estimators need a y distribution");
+        }
+    }
+    uint64_t seed = rng_seed_value(seed_sexp);
+
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+#ifdef _OPENMP
+    if (threads > replicates) threads = replicates;
+#else
+    threads = 1;
+#endif
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    int size = MAX(n, m);
+    size_t work_bytes = MAX(center_work_size(n, 2), spread_work_size(MAX(size, 1)));
+    work_bytes = MAX(work_bytes, sort_work_size(size));
+    if (y_dist) {
+        work_bytes = MAX(work_bytes, shift_work_size(n, m, 2));
+        work_bytes = MAX(work_bytes, spread_work_size(m));
+    }
+    size_t x_bytes = scratch_align(n * sizeof(double));
+    size_t y_bytes = scratch_align(MAX(m, 1) * sizeof(double));
+    size_t stride = 2 * x_bytes + 2 * y_bytes + scratch_align(work_bytes);
+    char *scratch = (char *) r_scratch_reserve((size_t)threads * stride);
+    int *status = (int *) R_alloc(replicates, sizeof(int));
+
+    SEXP result = PROTECT(allocMatrix(REALSXP, replicates, MAX(n_estimators, 0)));
+    double *out = REAL(result);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for (int r = 0; r < replicates; r++) {
+        status[r] = kernel_budget_poll(&budget);
+        if (status[r] != SIM_OK) continue;
+        char *base = scratch + (size_t)SIM_THREAD_NUM() * stride;
+        SimSlice slice = {
+            (double *) base,
+            (double *) (base + x_bytes),
+            (double *) (base + x_bytes + y_bytes),
+            (double *) (base + 2 * x_bytes + y_bytes),
+            base + 2 * x_bytes + 2 * y_bytes
+        };
+        Xoshiro256 rng;
+        xoshiro256_seed(&rng, seed + (uint64_t)r);
+        status[r] = simulate_replicate(&x_dist, y_dist, n, m, &rng, estimators, n_estimators,
+                                       &slice, &budget, out + r, replicates);
+    }
+
+    r_scratch_trim();
+    if (budget.stop) kernel_budget_fail(budget.stop);
+    for (int r = 0; r < replicates; r++) {
+        if (status[r] != SIM_OK) {
+            error("Convergence failure (pathological input)");
+        }
+    }
+    UNPROTECT(1);
+    return result;
+}
@@ -0,0 +1,151 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#include "radix_sort.h"
+#include "rng_impl.h"
+#include "scratch_arena.h"
+
+/*
+ * Partitions values[lo..hi] around the median of its first, middle and last
+ * values: on return [lo, *lt) < pivot, [*lt, *gt] == pivot, (*gt, hi] > pivot.
+ */
+static double partition_three_way(double *values, int lo, int hi, int *lt, int *gt) {
+    double a = values[lo];
+    double b = values[lo + (hi - lo) / 2];
+    double c = values[hi];
+    double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a))
+                           : ((a < c) ? a : ((b < c) ? c : b));
+
+    int l = lo, i = lo, g = hi;
+    while (i <= g) {
+        double value = values[i];
+        if (value < pivot) {
+            values[i++] = values[l];
+            values[l++] = value;
+        } else if (value > pivot) {
+            values[i] = values[g];
+            values[g--] = value;
+        } else {
+            i++;
+        }
+    }
+    *lt = l;
+    *gt = g;
+    return pivot;
+}
+
+/*
+ * Introselect: the value of 0-based rank k within values[lo..hi] (k in that
+ * range), reordering the range. Quickselect until `*budget` partitions are
+ * used up, then sort_doubles on what is left, so the worst case stays
+ * O(n log n).
+ */
+static double select_rank(double *values, int lo, int hi, int k, void *sort_work, int *budget) {
+    while (lo < hi) {
+        if ((*budget)-- <= 0) {
+            sort_doubles(values + lo, hi - lo + 1, sort_work);
+            return values[k];
+        }
+        int lt, gt;
+        double pivot = partition_three_way(values, lo, hi, &lt, &gt);
+        if (k < lt) {
+            hi = lt - 1;
+        } else if (k > gt) {
+            lo = gt + 1;
+        } else {
+            return pivot;
+        }
+    }
+    return values[k];
+}
+
+/*
+ * Values of the 0-based ranks k_low <= k_high of values[0..n). Partitions are
+ * shared while both ranks fall on the same side of the pivot; once they
+ * separate, each side is finished on its own disjoint subrange. Expected O(n).
+ */
+static void select_two_ranks(double *values, int n, int k_low, int k_high,
+                             void *sort_work, double *out) {
+    int budget = 4;
+    for (int size = n; size > 1; size >>= 1) budget += 2;
+
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        if (budget-- <= 0) {
+            sort_doubles(values + lo, hi - lo + 1, sort_work);
+            break;
+        }
+        int lt, gt;
+        double pivot = partition_three_way(values, lo, hi, &lt, &gt);
+        if (k_high < lt) {
+            hi = lt - 1;
+        } else if (k_low > gt) {
+            lo = gt + 1;
+        } else {
+            out[0] = k_low < lt ? select_rank(values, lo, lt - 1, k_low, sort_work, &budget) : pivot;
+            out[1] = k_high > gt ? select_rank(values, gt + 1, hi, k_high, sort_work, &budget) : pivot;
+            return;
+        }
+    }
+    out[0] = values[k_low];
+    out[1] = values[k_high];
+}
+
+/*
+ * Disjoint-pair order statistics of SpreadBounds.
+ *
+ * Shuffles the indices 0..n-1 with the generator (exactly as
+ * Rng$shuffle(seq(0, n - 1)) would), pairs consecutive shuffled indices into
+ * m = n / 2 disjoint pairs, and returns c(lower, upper): the k_left-th and
+ * k_right-th smallest (1-based) of the m absolute differences
+ * |values[a] - values[b]|, found by one shared two-rank selection rather than
+ * a full sort. The generator advances past the shuffle. Indices, differences
+ * and the selection's fallback sort scratch come from the R scratch arena.
+ */
+SEXP spread_bounds_pairs_c(SEXP values_sexp, SEXP rng_ptr, SEXP k_left_sexp, SEXP k_right_sexp) {
+    if (!isReal(values_sexp)) {
+        error("values must be a numeric vector");
+    }
+    Xoshiro256 *rng = rng_state(rng_ptr);
+    int n = length(values_sexp);
+    int m = n / 2;
+    int k_left = asInteger(k_left_sexp);
+    int k_right = asInteger(k_right_sexp);
+    if (m < 1) {
+        error("values must hold at least two elements");
+    }
+    if (k_left == NA_INTEGER || k_right == NA_INTEGER ||
+        k_left < 1 || k_right < 1 || k_left > m || k_right > m) {
+        error("ranks must be between 1 and n / 2");
+    }
+
+    size_t index_bytes = scratch_align((size_t)n * sizeof(int));
+    size_t diff_bytes = scratch_align((size_t)m * sizeof(double));
+    char *work = r_scratch_reserve(index_bytes + diff_bytes + sort_work_size(m));
+    int *indices = (int *) work;
+    double *diffs = (double *) (work + index_bytes);
+    void *sort_work = work + index_bytes + diff_bytes;
+
+    const double *values = REAL(values_sexp);
+    for (int i = 0; i < n; i++) {
+        indices[i] = i;
+    }
+    xoshiro256_shuffle_ints(rng, indices, n);
+    for (int i = 0; i < m; i++) {
+        diffs[i] = fabs(values[indices[2 * i]] - values[indices[2 * i + 1]]);
+    }
+
+    SEXP result = PROTECT(allocVector(REALSXP, 2));
+    double *bounds = REAL(result);
+    if (k_left <= k_right) {
+        select_two_ranks(diffs, m, k_left - 1, k_right - 1, sort_work, bounds);
+    } else {
+        double swapped[2];
+        select_two_ranks(diffs, m, k_right - 1, k_left - 1, sort_work, swapped);
+        bounds[0] = swapped[1];
+        bounds[1] = swapped[0];
+    }
+    r_scratch_trim();
+    UNPROTECT(1);
+    return result;
+}
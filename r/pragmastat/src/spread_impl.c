@@ -2,49 +2,252 @@
 #include <Rinternals.h>
 #include <math.h>
 #include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "spread_impl.h"
+#include "scratch_arena.h"
+#include "weighted_impl.h"
+#include "radix_sort.h"
+#include "native_input.h"
+#include "sweep_select.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define ABS(a) ((a) < 0 ? -(a) : (a))
 
 /*
- * O(n log n) implementation of the Spread (Shamos) estimator
- * Computes the median of all pairwise absolute differences efficiently
+ * Intra-call parallelism, as in center_impl: with blocks > 1 the partition
+ * sweep is cut into contiguous row blocks, one per OpenMP thread. A block
+ * starts its two-pointer at the column the serial sweep would reach there
+ * (binary search); block results are combined in block order with the serial
+ * update rules, so on sorted input every pass matches the serial sweep exactly.
+ * Blocks start on chunk boundaries, so every chunk size has a single writer.
  */
-SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
-    // Input validation
-    if (!isReal(values_sexp)) {
-        error("Input must be a numeric vector");
+
+/* Number of row blocks for `threads` workers: serial below 2^15 rows per block */
+static int spread_blocks(int n, int threads) {
+    int blocks = MIN(threads, SPREAD_MAX_THREADS);
+    blocks = MIN(blocks, n >> 15);
+    return MAX(blocks, 1);
+}
+
+/* Number of SPREAD_CHUNK_ROWS-row chunks covering n rows */
+static inline size_t spread_chunks(int n) {
+    return ((size_t)n + SPREAD_CHUNK_ROWS - 1) / SPREAD_CHUNK_ROWS;
+}
+
+static inline int spread_block_begin(int rows, int blocks, int block) {
+    if (block >= blocks) return rows;
+    int row = (int)((long long)rows * block / blocks);
+    return row - row % SPREAD_CHUNK_ROWS;
+}
+
+/*
+ * Window update decided by the last pass but not yet written: the next sweep
+ * applies it row by row before partitioning that row, so shrinking the active
+ * set costs no pass of its own.
+ */
+typedef enum {
+    SPREAD_KEEP_ALL,
+    SPREAD_DISCARD_BELOW,
+    SPREAD_KEEP_BELOW
+} SpreadShrink;
+
+/*
+ * Per-row state of one selection, held in the caller's scratch. Column bounds
+ * and per-row counts are below n and stay 32-bit; only the chunk sizes, summed
+ * over rows, need 64 bits.
+ */
+typedef struct {
+    const double *sorted_values;
+    int n;
+    int *row_counts;
+    int *L;
+    int *R_bounds;
+    long long *chunk_discard_sizes;
+    long long *chunk_keep_sizes;
+} SpreadSelection;
+
+/* Partition result of one row block */
+typedef struct {
+    long long count_below;
+    double largest_below;
+    double smallest_at_or_above;
+    long long size_discard;  // active set size once the differences below the pivot are discarded
+    long long size_keep;     // active set size once only the differences below the pivot are kept
+} SpreadPartition;
+
+/* Narrow the active window of row i to one side of the pivot */
+static inline void spread_shrink_row(const SpreadSelection *sel, SpreadShrink shrink, int i) {
+    int *L = sel->L;
+    int *R_bounds = sel->R_bounds;
+    if (shrink == SPREAD_DISCARD_BELOW) {
+        // Need larger differences: discard all strictly below pivot
+        int new_L = i + 1 + sel->row_counts[i];
+        if (new_L > L[i]) L[i] = new_L;
+        if (L[i] > R_bounds[i]) {
+            L[i] = 1;
+            R_bounds[i] = 0; // mark empty
+        }
+    } else if (shrink == SPREAD_KEEP_BELOW) {
+        // Too many below: keep only those strictly below pivot
+        int new_R = i + sel->row_counts[i];
+        if (new_R < R_bounds[i]) R_bounds[i] = new_R;
+        if (R_bounds[i] < i + 1) {
+            L[i] = 1;
+            R_bounds[i] = 0; // empty row
+        }
     }
+}
 
-    int n = length(values_sexp);
-    if (n <= 1) {
-        SEXP result = PROTECT(allocVector(REALSXP, 1));
-        REAL(result)[0] = 0.0;
-        UNPROTECT(1);
-        return result;
+/* Active window [*lo, *hi] row i would have after `shrink`; empty when *lo > *hi */
+static inline void spread_row_window(const SpreadSelection *sel, SpreadShrink shrink, int i,
+                                     int count, int *lo, int *hi) {
+    *lo = sel->L[i];
+    *hi = sel->R_bounds[i];
+    if (shrink == SPREAD_DISCARD_BELOW) {
+        *lo = MAX(*lo, i + 1 + count);
+    } else if (shrink == SPREAD_KEEP_BELOW) {
+        *hi = MIN(*hi, i + count);
+        if (*hi < i + 1) *hi = *lo - 1;
     }
+}
 
-    if (n == 2) {
-        double *values = REAL(values_sexp);
-        SEXP result = PROTECT(allocVector(REALSXP, 1));
-        REAL(result)[0] = fabs(values[1] - values[0]);
-        UNPROTECT(1);
-        return result;
+/*
+ * One fused sweep over rows [row_begin, row_end) (row_begin on a chunk
+ * boundary): applies the pending `shrink` to each row's window, partitions the
+ * row around the pivot with the two-pointer scan, tracks the closest
+ * differences on each side, and records per chunk the active set sizes both
+ * possible next shrinks would leave.
+ */
+static void spread_sweep_rows(const SpreadSelection *sel, SpreadShrink shrink, double pivot,
+                              int row_begin, int row_end, SpreadPartition *result) {
+    const double *sorted_values = sel->sorted_values;
+    int n = sel->n;
+    long long count_below = 0;
+    double largest_below = -INFINITY;
+    double smallest_at_or_above = INFINITY;
+    long long size_discard = 0;
+    long long size_keep = 0;
+
+    int j = row_begin + 1; // two-pointer (0-based)
+    if (row_begin > 0) {
+        // First column at or above the pivot: where the serial pointer stands
+        int lo = row_begin + 1, hi = n;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (sorted_values[mid] - sorted_values[row_begin] < pivot) lo = mid + 1; else hi = mid;
+        }
+        j = lo;
     }
 
-    // Use input directly when sorted; otherwise sort a copy
-    int assume_sorted = asLogical(assume_sorted_sexp);
-    double *values = REAL(values_sexp);
-    double *a;
-    if (assume_sorted) {
-        a = values;
-    } else {
-        a = (double *) R_alloc(n, sizeof(double));
-        for (int i = 0; i < n; i++) {
-            a[i] = values[i];
+    for (int chunk_begin = row_begin; chunk_begin < row_end; chunk_begin += SPREAD_CHUNK_ROWS) {
+        int chunk_end = MIN(chunk_begin + SPREAD_CHUNK_ROWS, row_end);
+        long long chunk_discard = 0;
+        long long chunk_keep = 0;
+        for (int i = chunk_begin; i < chunk_end; i++) {
+            spread_shrink_row(sel, shrink, i);
+
+            if (j < i + 1) j = i + 1;
+            while (j < n && sorted_values[j] - sorted_values[i] < pivot) j++;
+
+            int cnt_row = j - (i + 1);
+            if (cnt_row < 0) cnt_row = 0;
+            sel->row_counts[i] = cnt_row;
+            count_below += cnt_row;
+
+            // Boundary elements for this row
+            if (cnt_row > 0) {
+                double cand_below = sorted_values[j - 1] - sorted_values[i];
+                if (cand_below > largest_below) largest_below = cand_below;
+            }
+
+            if (j < n) {
+                double cand_at_or_above = sorted_values[j] - sorted_values[i];
+                if (cand_at_or_above < smallest_at_or_above) {
+                    smallest_at_or_above = cand_at_or_above;
+                }
+            }
+
+            int lo, hi;
+            spread_row_window(sel, SPREAD_DISCARD_BELOW, i, cnt_row, &lo, &hi);
+            if (lo <= hi) chunk_discard += hi - lo + 1;
+            spread_row_window(sel, SPREAD_KEEP_BELOW, i, cnt_row, &lo, &hi);
+            if (lo <= hi) chunk_keep += hi - lo + 1;
         }
-        R_rsort(a, n);
+        sel->chunk_discard_sizes[chunk_begin / SPREAD_CHUNK_ROWS] = chunk_discard;
+        sel->chunk_keep_sizes[chunk_begin / SPREAD_CHUNK_ROWS] = chunk_keep;
+        size_discard += chunk_discard;
+        size_keep += chunk_keep;
+    }
+
+    result->count_below = count_below;
+    result->largest_below = largest_below;
+    result->smallest_at_or_above = smallest_at_or_above;
+    result->size_discard = size_discard;
+    result->size_keep = size_keep;
+}
+
+/*
+ * Next pivot once `shrink` is applied: the median column of the row holding
+ * the middle element. Whole chunks are skipped by their recorded sizes and only
+ * the chunk holding the middle element is walked, shrinking its windows on the
+ * fly.
+ */
+static double spread_chunk_pivot(const SpreadSelection *sel, SpreadShrink shrink, long long active_size) {
+    const long long *chunk_sizes = shrink == SPREAD_DISCARD_BELOW ? sel->chunk_discard_sizes : sel->chunk_keep_sizes;
+    long long t = active_size / 2;
+    long long acc = 0;
+    int chunk = 0;
+    while (t >= acc + chunk_sizes[chunk]) {
+        acc += chunk_sizes[chunk++];
+    }
+
+    int row = chunk * SPREAD_CHUNK_ROWS;
+    int row_end = MIN(row + SPREAD_CHUNK_ROWS, sel->n - 1);
+    int lo = 1, hi = 0;
+    for (; row < row_end; row++) {
+        spread_row_window(sel, shrink, row, sel->row_counts[row], &lo, &hi);
+        if (lo > hi) continue;
+        long long size = hi - lo + 1;
+        if (t < acc + size) break;
+        acc += size;
+    }
+
+    // Median column of the selected row
+    int col = (lo + hi) / 2;
+    return sel->sorted_values[col] - sel->sorted_values[row];
+}
+
+/*
+ * Core computation: Spread (Shamos) estimator over sorted values.
+ * Monahan-style selection over the pairwise differences with per-row active
+ * bounds held in the caller's scratch; see spread_impl.h. Each pass is a single
+ * sweep that also applies the previous shrink and sizes both possible next
+ * active sets, so the next pivot needs no pass of its own.
+ */
+static int spread_median_select(const double *sorted_values, int n, void *work, int threads,
+                                KernelStats *stats, KernelBudget *budget, double *out);
+
+int spread_median_compute(const double *sorted_values, int n, void *work, int threads, double *out,
+                          KernelBudget *budget) {
+    return spread_median_select(sorted_values, n, work, threads, NULL, budget, out);
+}
+
+/*
+ * The selection behind both entry points; work is counted into `stats` and
+ * every pass polls `budget`, unless NULL
+ */
+static int spread_median_select(const double *sorted_values, int n, void *work, int threads,
+                                KernelStats *stats, KernelBudget *budget, double *out) {
+    if (n <= 1) {
+        *out = 0.0;
+        return SPREAD_OK;
+    }
+    if (n == 2) {
+        *out = fabs(sorted_values[1] - sorted_values[0]);
+        return SPREAD_OK;
     }
 
     // Total number of pairwise differences with i < j
@@ -52,10 +255,23 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
     long long k_low = (N + 1) / 2;
     long long k_high = (N + 2) / 2;
 
-    // Per-row active bounds (0-based indexing)
-    int *L = (int *) R_alloc(n, sizeof(int));
-    int *R_bounds = (int *) R_alloc(n, sizeof(int));
-    long long *row_counts = (long long *) R_alloc(n, sizeof(long long));
+    // Per-row active bounds (0-based indexing) share the caller's scratch
+    SpreadSelection sel;
+    sel.sorted_values = sorted_values;
+    sel.n = n;
+    size_t chunks = spread_chunks(n);
+    sel.chunk_discard_sizes = (long long *)work;
+    sel.chunk_keep_sizes = sel.chunk_discard_sizes + chunks;
+    sel.row_counts = (int *)(sel.chunk_keep_sizes + chunks);
+    sel.L = sel.row_counts + n;
+    sel.R_bounds = sel.L + n;
+    int *L = sel.L;
+    int *R_bounds = sel.R_bounds;
+
+    // The sweeps run over rows [0, n - 1)
+    const int rows = n - 1;
+    const int blocks = spread_blocks(n, threads);
+    SpreadPartition partitions[SPREAD_MAX_THREADS];
 
     for (int i = 0; i < n; i++) {
         L[i] = i + 1;      // Row i allows columns [i+1, n-1]
@@ -67,8 +283,9 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
     }
 
     // Initial pivot: a central gap
-    double pivot = a[n / 2] - a[(n - 1) / 2];
+    double pivot = sorted_values[n / 2] - sorted_values[(n - 1) / 2];
     long long prev_count_below = -1;
+    SpreadShrink shrink = SPREAD_KEEP_ALL;
 
     /*
      * Bound the selection loop. On valid sorted input the Monahan-style
@@ -80,9 +297,7 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
      * valid inputs are never starved, and it counts EVERY pass through the
      * loop, so it also terminates the stall-handling ping-pong mode. We
      * additionally track no-progress (stall) on the active set to bail out
-     * deterministically (mirrors center_impl's guard). R_alloc'd buffers are
-     * reclaimed automatically when error() unwinds, so no manual free is
-     * needed on the error path.
+     * deterministically (mirrors center_impl's guard).
      */
     const int base_iterations = 256;
     const int max_iterations = base_iterations + 4 * n;
@@ -91,58 +306,63 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
     const int max_stall = 8;
 
     for (int iter = 0; iter < max_iterations; iter++) {
-        // === PARTITION: count how many differences are < pivot ===
-        long long count_below = 0;
-        double largest_below = R_NegInf;
-        double smallest_at_or_above = R_PosInf;
-
-        int j = 1; // global two-pointer (0-based)
-        for (int i = 0; i < n - 1; i++) {
-            if (j < i + 1) j = i + 1;
-            while (j < n && a[j] - a[i] < pivot) j++;
-
-            long long cnt_row = j - (i + 1);
-            if (cnt_row < 0) cnt_row = 0;
-            row_counts[i] = cnt_row;
-            count_below += cnt_row;
-
-            // Boundary elements for this row
-            if (cnt_row > 0) {
-                double cand_below = a[j - 1] - a[i];
-                if (cand_below > largest_below) largest_below = cand_below;
+        int stop = kernel_budget_poll(budget);
+        if (stop) return stop;
+        KERNEL_STATS_ADD(stats, passes, 1);
+        KERNEL_STATS_ADD(stats, sweeps, 1);
+
+        // === PARTITION: apply the pending shrink, count how many differences are < pivot ===
+        if (blocks > 1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(blocks) schedule(static, 1)
+#endif
+            for (int block = 0; block < blocks; block++) {
+                spread_sweep_rows(&sel, shrink, pivot, spread_block_begin(rows, blocks, block),
+                                  spread_block_begin(rows, blocks, block + 1), &partitions[block]);
             }
+        } else {
+            spread_sweep_rows(&sel, shrink, pivot, 0, rows, &partitions[0]);
+        }
+        shrink = SPREAD_KEEP_ALL;
 
-            if (j < n) {
-                double cand_at_or_above = a[j] - a[i];
-                if (cand_at_or_above < smallest_at_or_above) {
-                    smallest_at_or_above = cand_at_or_above;
-                }
+        long long count_below = 0;
+        double largest_below = -INFINITY;
+        double smallest_at_or_above = INFINITY;
+        long long size_discard = 0;
+        long long size_keep = 0;
+        for (int block = 0; block < blocks; block++) {
+            count_below += partitions[block].count_below;
+            if (partitions[block].largest_below > largest_below) {
+                largest_below = partitions[block].largest_below;
+            }
+            if (partitions[block].smallest_at_or_above < smallest_at_or_above) {
+                smallest_at_or_above = partitions[block].smallest_at_or_above;
             }
+            size_discard += partitions[block].size_discard;
+            size_keep += partitions[block].size_keep;
         }
 
         // === TARGET CHECK ===
         int at_target = (count_below == k_low) || (count_below == k_high - 1);
 
         if (at_target) {
-            SEXP result = PROTECT(allocVector(REALSXP, 1));
-
             if (k_low < k_high) {
                 // Even N: average the two central order stats
-                REAL(result)[0] = 0.5 * largest_below + 0.5 * smallest_at_or_above;
+                *out = 0.5 * largest_below + 0.5 * smallest_at_or_above;
             } else {
                 // Odd N: pick the single middle
                 int need_largest = (count_below == k_low);
-                REAL(result)[0] = need_largest ? largest_below : smallest_at_or_above;
+                *out = need_largest ? largest_below : smallest_at_or_above;
             }
-
-            UNPROTECT(1);
-            return result;
+            return SPREAD_OK;
         }
 
         // === STALL HANDLING ===
         if (count_below == prev_count_below) {
-            double min_active = R_PosInf;
-            double max_active = R_NegInf;
+            KERNEL_STATS_ADD(stats, stall_passes, 1);
+            KERNEL_STATS_ADD(stats, sweeps, 1);
+            double min_active = INFINITY;
+            double max_active = -INFINITY;
             long long active = 0;
 
             for (int i = 0; i < n - 1; i++) {
@@ -150,29 +370,25 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
                 int Ri = R_bounds[i];
                 if (Li > Ri) continue;
 
-                double row_min = a[Li] - a[i];
-                double row_max = a[Ri] - a[i];
+                double row_min = sorted_values[Li] - sorted_values[i];
+                double row_max = sorted_values[Ri] - sorted_values[i];
                 if (row_min < min_active) min_active = row_min;
                 if (row_max > max_active) max_active = row_max;
                 active += (Ri - Li + 1);
             }
 
             if (active <= 0) {
-                SEXP result = PROTECT(allocVector(REALSXP, 1));
                 if (k_low < k_high) {
-                    REAL(result)[0] = 0.5 * largest_below + 0.5 * smallest_at_or_above;
+                    *out = 0.5 * largest_below + 0.5 * smallest_at_or_above;
                 } else {
-                    REAL(result)[0] = (count_below >= k_low) ? largest_below : smallest_at_or_above;
+                    *out = (count_below >= k_low) ? largest_below : smallest_at_or_above;
                 }
-                UNPROTECT(1);
-                return result;
+                return SPREAD_OK;
             }
 
             if (max_active <= min_active) {
-                SEXP result = PROTECT(allocVector(REALSXP, 1));
-                REAL(result)[0] = min_active;
-                UNPROTECT(1);
-                return result;
+                *out = min_active;
+                return SPREAD_OK;
             }
 
             double mid = 0.5 * min_active + 0.5 * max_active;
@@ -183,39 +399,13 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
             continue;
         }
 
-        // === SHRINK ACTIVE WINDOW ===
-        if (count_below < k_low) {
-            // Need larger differences: discard all strictly below pivot
-            for (int i = 0; i < n - 1; i++) {
-                int new_L = i + 1 + (int)row_counts[i];
-                if (new_L > L[i]) L[i] = new_L;
-                if (L[i] > R_bounds[i]) {
-                    L[i] = 1;
-                    R_bounds[i] = 0; // mark empty
-                }
-            }
-        } else {
-            // Too many below: keep only those strictly below pivot
-            for (int i = 0; i < n - 1; i++) {
-                int new_R = i + (int)row_counts[i];
-                if (new_R < R_bounds[i]) R_bounds[i] = new_R;
-                if (R_bounds[i] < i + 1) {
-                    L[i] = 1;
-                    R_bounds[i] = 0; // empty row
-                }
-            }
-        }
+        // === SHRINK ACTIVE WINDOW (applied by the next sweep) ===
+        // Too few below: discard all strictly below pivot; otherwise keep only those
+        shrink = count_below < k_low ? SPREAD_DISCARD_BELOW : SPREAD_KEEP_BELOW;
+        long long active_size = shrink == SPREAD_DISCARD_BELOW ? size_discard : size_keep;
 
         prev_count_below = count_below;
 
-        // === CHOOSE NEXT PIVOT FROM ACTIVE SET ===
-        long long active_size = 0;
-        for (int i = 0; i < n - 1; i++) {
-            if (L[i] <= R_bounds[i]) {
-                active_size += (R_bounds[i] - L[i] + 1);
-            }
-        }
-
         /*
          * Stall detection: on valid sorted input the active set strictly
          * shrinks toward the target. If it fails to shrink for several
@@ -223,6 +413,7 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
          * assume_sorted=TRUE on unsorted data) and we bail deterministically.
          */
         if (active_size >= previous_active_set_size && previous_active_set_size >= 0) {
+            KERNEL_STATS_ADD(stats, stall_passes, 1);
             if (++stall_count >= max_stall) {
                 break;
             }
@@ -233,65 +424,156 @@ SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp) {
 
         if (active_size <= 2) {
             // Few candidates left: return midrange of remaining
-            double min_rem = R_PosInf;
-            double max_rem = R_NegInf;
+            KERNEL_STATS_ADD(stats, sweeps, 1);
+            if (stats) stats->endgame = 1;
+            double min_rem = INFINITY;
+            double max_rem = -INFINITY;
 
             for (int i = 0; i < n - 1; i++) {
+                spread_shrink_row(&sel, shrink, i);
                 if (L[i] > R_bounds[i]) continue;
-                double lo = a[L[i]] - a[i];
-                double hi = a[R_bounds[i]] - a[i];
+                double lo = sorted_values[L[i]] - sorted_values[i];
+                double hi = sorted_values[R_bounds[i]] - sorted_values[i];
                 if (lo < min_rem) min_rem = lo;
                 if (hi > max_rem) max_rem = hi;
             }
 
             if (active_size <= 0) {
-                SEXP result = PROTECT(allocVector(REALSXP, 1));
                 if (k_low < k_high) {
-                    REAL(result)[0] = 0.5 * largest_below + 0.5 * smallest_at_or_above;
+                    *out = 0.5 * largest_below + 0.5 * smallest_at_or_above;
                 } else {
-                    REAL(result)[0] = (count_below >= k_low) ? largest_below : smallest_at_or_above;
+                    *out = (count_below >= k_low) ? largest_below : smallest_at_or_above;
                 }
-                UNPROTECT(1);
-                return result;
+                return SPREAD_OK;
             }
 
-            SEXP result = PROTECT(allocVector(REALSXP, 1));
             if (k_low < k_high) {
-                REAL(result)[0] = 0.5 * min_rem + 0.5 * max_rem;
+                *out = 0.5 * min_rem + 0.5 * max_rem;
             } else {
                 long long dist_low = llabs((k_low - 1) - count_below);
                 long long dist_high = llabs(count_below - k_low);
-                REAL(result)[0] = (dist_low <= dist_high) ? min_rem : max_rem;
+                *out = (dist_low <= dist_high) ? min_rem : max_rem;
             }
-            UNPROTECT(1);
-            return result;
+            return SPREAD_OK;
 
         } else {
-            // Deterministic middle-element selection
-            long long t = active_size / 2;
-            long long acc = 0;
-            int row = 0;
-
-            for (int r = 0; r < n - 1; r++) {
-                if (L[r] > R_bounds[r]) continue;
-                long long size = R_bounds[r] - L[r] + 1;
-                if (t < acc + size) {
-                    row = r;
-                    break;
-                }
-                acc += size;
-            }
-
-            // Median column of the selected row
-            int col = (L[row] + R_bounds[row]) / 2;
-            pivot = a[col] - a[row];
+            // === CHOOSE NEXT PIVOT FROM ACTIVE SET: deterministic middle element ===
+            pivot = spread_chunk_pivot(&sel, shrink, active_size);
         }
     }
 
     // Non-convergence: iteration cap reached or the stall guard tripped; only
     // reachable on pathological input (e.g. unsorted values passed with
-    // assume_sorted=TRUE). R_alloc buffers are freed automatically by the R
-    // memory manager when error() unwinds.
-    error("Convergence failure (pathological input)");
-    return R_NilValue;
+    // assume_sorted=TRUE).
+    return SPREAD_NO_CONVERGENCE;
+}
+
+/* Scratch layout: the two per-chunk size arrays, then row counts, L and R_bounds */
+size_t spread_work_size(int n) {
+    return 2 * spread_chunks(n) * sizeof(long long) + 3 * (size_t)n * sizeof(int);
+}
+
+/*
+ * Core computation: Spread (Shamos) estimator on `values` (read in place when
+ * assume_sorted, else through a sorted copy). The copy and the selection
+ * scratch share the R scratch arena.
+ */
+double spread_impl_compute(const double *values, int n, int assume_sorted, int threads,
+                           KernelStats *stats, KernelBudget *budget) {
+    size_t copy_bytes = assume_sorted || n <= 2 ? 0 : scratch_align(n * sizeof(double));
+    size_t work_bytes = spread_work_size(n > 2 ? n : 1);
+    if (copy_bytes > 0) work_bytes = MAX(work_bytes, sort_work_size(n));
+    work_bytes = MAX(work_bytes, ties_work_size(n / TIES_MAX_RUN_FRACTION));
+    char *scratch = (char *) r_scratch_reserve(copy_bytes + work_bytes);
+
+    // Use input directly when sorted; otherwise sort a copy (the sort scratch is then reused)
+    double mark = stats ? kernel_clock() : 0;
+    const double *a = values;
+    if (copy_bytes > 0) {
+        double *copy = (double *) scratch;
+        for (int i = 0; i < n; i++) {
+            copy[i] = a[i];
+        }
+        sort_doubles(copy, n, scratch + copy_bytes);
+        a = copy;
+    }
+    KERNEL_STATS_LAP(stats, sort_seconds, mark);
+
+    // Heavily tied input: select over the distinct values (same result, and
+    // the weighted search terminates on any finite input; the WEIGHTED_*
+    // status codes coincide with SPREAD_*)
+    double spread_value;
+    int status;
+    int runs = n >= TIES_MIN_SIZE ? sorted_runs(a, n) : n;
+    if (ties_compressible(n, runs)) {
+        if (stats) stats->ties_compressed = 1;
+        status = ties_spread_compute_ws(a, 0, n, runs, scratch + copy_bytes, &spread_value, stats, budget);
+    } else {
+        status = spread_median_select(a, n, scratch + copy_bytes, threads, stats, budget,
+                                      &spread_value);
+    }
+    KERNEL_STATS_LAP(stats, select_seconds, mark);
+    r_scratch_trim();
+    if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+    if (status != SPREAD_OK) {
+        error("Convergence failure (pathological input)");
+    }
+    return spread_value;
+}
+
+/*
+ * O(n log n) implementation of the Spread (Shamos) estimator
+ * Computes the median of all pairwise absolute differences efficiently.
+ * With `diagnostics_sexp` TRUE the result carries the selection's work
+ * counters and timings as its "diagnostics" attribute (see kernel_stats.h).
+ * The selection polls for user interrupts and stops at `deadline_sexp` (see
+ * kernel_budget.h).
+ */
+SEXP spread_impl_c(SEXP values_sexp, SEXP assume_sorted_sexp, SEXP threads_sexp, SEXP diagnostics_sexp,
+                   SEXP deadline_sexp) {
+    int n = length(values_sexp);
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+    KernelStats record = { 0 };
+    KernelStats *stats = asLogical(diagnostics_sexp) == TRUE ? &record : NULL;
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+
+    // Integer input is selected as sorted ints, in place when assume_sorted;
+    // heavily tied ints go to the tie compression, which promotes only the
+    // distinct values
+    double mark = stats ? kernel_clock() : 0;
+    int assume_sorted = asLogical(assume_sorted_sexp);
+    int is_int;
+    const void *a = native_input(values_sexp, &assume_sorted, &is_int);
+    KERNEL_STATS_LAP(stats, sort_seconds, mark);
+    double spread_value;
+    if (is_int) {
+        int status;
+        int runs = n >= TIES_MIN_SIZE ? sorted_int_runs(a, n) : n;
+        if (ties_compressible(n, runs)) {
+            if (stats) stats->ties_compressed = 1;
+            void *work = r_scratch_reserve(ties_work_size(runs));
+            status = ties_spread_compute_ws(a, 1, n, runs, work, &spread_value, stats, &budget);
+            r_scratch_trim();
+        } else {
+            SweepPairs pairs = { SWEEP_SPREAD, 1, a, n, NULL, 0, threads };
+            status = sweep_median_compute(&pairs, &spread_value, stats, &budget);
+        }
+        KERNEL_STATS_LAP(stats, select_seconds, mark);
+        if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+        if (status != SPREAD_OK) {
+            error("Convergence failure (pathological input)");
+        }
+    } else {
+        spread_value = spread_impl_compute(a, n, assume_sorted, threads, stats, &budget);
+    }
+
+    SEXP result = PROTECT(allocVector(REALSXP, 1));
+    REAL(result)[0] = spread_value;
+    if (stats) kernel_stats_attach(result, stats);
+    UNPROTECT(1);
+    return result;
 }
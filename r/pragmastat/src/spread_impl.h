@@ -0,0 +1,45 @@
+#ifndef SPREAD_IMPL_H
+#define SPREAD_IMPL_H
+
+#include <stddef.h>
+#include "kernel_stats.h"
+#include "kernel_budget.h"
+
+/* Status codes of spread_median_compute */
+#define SPREAD_OK 0
+#define SPREAD_NO_CONVERGENCE 2
+
+/* Most threads one selection splits its passes over */
+#define SPREAD_MAX_THREADS 256
+
+/* Rows per chunk of the per-chunk active set sizes kept by the selection */
+#define SPREAD_CHUNK_ROWS 512
+
+/* Scratch bytes spread_median_compute needs for n values */
+size_t spread_work_size(int n);
+
+/*
+ * Median of the n(n-1)/2 pairwise absolute differences |x[i] - x[j]|, i < j,
+ * of `sorted_values` (sorted ascending) into *out. `work` must hold
+ * spread_work_size(n) bytes aligned for long long (e.g. from malloc or a
+ * ScratchArena); it is overwritten and nothing is allocated. With threads > 1
+ * the O(n) passes of large inputs run on up to `threads` OpenMP threads; the
+ * result does not depend on the thread count. Every pass polls `budget`
+ * unless NULL (see kernel_budget.h). Never raises an R error; returns
+ * SPREAD_OK, SPREAD_NO_CONVERGENCE or the budget's stopped status.
+ */
+int spread_median_compute(const double *sorted_values, int n, void *work, int threads, double *out,
+                          KernelBudget *budget);
+
+/*
+ * Spread of `values` (n > 0); a sorted copy is made unless assume_sorted, in
+ * which case `values` must be sorted ascending and is read in place. Scratch
+ * comes from the R scratch arena; raises an R error on convergence failure.
+ * Work and timings are added to `stats` unless NULL (see kernel_stats.h), and
+ * the selection stops with an R error once `budget` (unless NULL) runs out
+ * (see kernel_budget.h).
+ */
+double spread_impl_compute(const double *values, int n, int assume_sorted, int threads,
+                           KernelStats *stats, KernelBudget *budget);
+
+#endif
@@ -0,0 +1,130 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <stdlib.h>
+#include <string.h>
+#include "center_impl.h"
+#include "spread_impl.h"
+#include "kernel_budget.h"
+#include "scratch_arena.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static int cmp_rank_sm(const void *a, const void *b) {
+    long long ra = *(const long long *)a;
+    long long rb = *(const long long *)b;
+    if (ra < rb) return -1;
+    if (ra > rb) return 1;
+    return 0;
+}
+
+/* Index of `rank` in the ascending, duplicate-free `ranks` array */
+static int find_rank_sm(const long long *ranks, int n_ranks, long long rank) {
+    int lo = 0, hi = n_ranks - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ranks[mid] < rank) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Fused one-sample summary over a sorted buffer.
+ *
+ * Returns c(center, spread, lower, upper): the Center and Spread estimates and,
+ * when `bounds_ranks_sexp` holds two 1-based pairwise-average ranks, the
+ * Center bounds at those ranks (NA otherwise). The sparity check is left to
+ * the caller (spread <= 0). One working buffer serves both selections, and the
+ * two median ranks and the two bounds ranks of Center are selected together in
+ * one shared center_ranks_compute_ws pass, so small samples pay for a single
+ * .Call, no allocation once the scratch arena has grown, and no repeated
+ * validation.
+ *
+ * @param sorted_sexp Numeric vector, sorted ascending (read in place)
+ * @param bounds_ranks_sexp Numeric vector of length 0 or 2
+ * @param deadline_sexp Numeric: deadline of both selections (see kernel_budget.h)
+ * @return Named numeric vector of length 4
+ */
+SEXP summary_impl_c(SEXP sorted_sexp, SEXP bounds_ranks_sexp, SEXP deadline_sexp) {
+    if (!isReal(sorted_sexp) || !isReal(bounds_ranks_sexp)) {
+        error("values and ranks must be numeric");
+    }
+
+    int n = length(sorted_sexp);
+    if (n == 0) {
+        error("Input vector cannot be empty");
+    }
+    int has_bounds = length(bounds_ranks_sexp) == 2;
+    if (!has_bounds && length(bounds_ranks_sexp) != 0) {
+        error("bounds ranks must have length 0 or 2");
+    }
+
+    const double *sorted_values = REAL(sorted_sexp);
+    long long total_pairs = ((long long)n * (n + 1)) / 2;
+
+    // Median ranks of Center, followed by the requested bounds ranks
+    long long requested[4] = { (total_pairs + 1) / 2, (total_pairs + 2) / 2, 0, 0 };
+    int n_requested = 2;
+    if (has_bounds) {
+        const double *bounds_ranks = REAL(bounds_ranks_sexp);
+        for (int i = 0; i < 2; i++) {
+            if (ISNAN(bounds_ranks[i]) || bounds_ranks[i] < 1 || bounds_ranks[i] > (double)total_pairs) {
+                error("ranks must be between 1 and n(n+1)/2");
+            }
+            requested[n_requested++] = (long long)bounds_ranks[i];
+        }
+    }
+
+    long long ranks[4];
+    memcpy(ranks, requested, sizeof(ranks));
+    qsort(ranks, n_requested, sizeof(long long), cmp_rank_sm);
+    int n_ranks = 0;
+    for (int i = 0; i < n_requested; i++) {
+        if (n_ranks == 0 || ranks[n_ranks - 1] != ranks[i]) {
+            ranks[n_ranks++] = ranks[i];
+        }
+    }
+
+    // One scratch block from the R scratch arena serves Spread, then Center
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    void *work = r_scratch_reserve(MAX(center_work_size(n, n_ranks), spread_work_size(n)));
+
+    double spread_value;
+    double rank_values[4];
+    int status = spread_median_compute(sorted_values, n, work, 1, &spread_value, &budget);
+    if (status == SPREAD_OK) {
+        status = center_ranks_compute_ws(sorted_values, n, ranks, n_ranks, rank_values, work, 1, &budget);
+    }
+    r_scratch_trim();
+    if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+    if (status != CENTER_OK) {
+        error("Convergence failure (pathological input)");
+    }
+
+    double median_lo = rank_values[find_rank_sm(ranks, n_ranks, requested[0])];
+    double median_hi = rank_values[find_rank_sm(ranks, n_ranks, requested[1])];
+
+    SEXP result = PROTECT(allocVector(REALSXP, 4));
+    double *out = REAL(result);
+    // Same arithmetic as center_impl_compute: midpoint of the two middle values
+    out[0] = requested[0] < requested[1] ? 0.5 * median_lo + 0.5 * median_hi : median_lo;
+    out[1] = spread_value;
+    out[2] = NA_REAL;
+    out[3] = NA_REAL;
+    if (has_bounds) {
+        double lower = rank_values[find_rank_sm(ranks, n_ranks, requested[2])];
+        double upper = rank_values[find_rank_sm(ranks, n_ranks, requested[3])];
+        out[2] = lower <= upper ? lower : upper;
+        out[3] = lower <= upper ? upper : lower;
+    }
+
+    SEXP names = PROTECT(allocVector(STRSXP, 4));
+    SET_STRING_ELT(names, 0, mkChar("center"));
+    SET_STRING_ELT(names, 1, mkChar("spread"));
+    SET_STRING_ELT(names, 2, mkChar("lower"));
+    SET_STRING_ELT(names, 3, mkChar("upper"));
+    setAttrib(result, R_NamesSymbol, names);
+
+    UNPROTECT(2);
+    return result;
+}
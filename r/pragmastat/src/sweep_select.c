@@ -0,0 +1,300 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "sweep_select.h"
+#include "count_kernels.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Probes remembered across the ranks of one call (later probes are not logged) */
+#define SWEEP_LOG_SIZE 512
+
+/*
+ * One counting sweep at a threshold: the number of pair values at or below
+ * it, the largest of those (-Inf when none) and the smallest value above it
+ * (+Inf when none).
+ */
+typedef struct {
+    long long count_le;
+    double below;
+    double above;
+} SweepCount;
+
+static inline void sweep_count_add(SweepCount *acc, long long count, double below, double above) {
+    acc->count_le += count;
+    if (below > acc->below) acc->below = below;
+    if (above < acc->above) acc->above = above;
+}
+
+/*
+ * Row sweeps over rows [r0, r1) of one element type. Each starts its pointer
+ * by a binary search at row r0, so blocks of rows sweep independently, then
+ * moves it monotonically with the count kernels, exactly as one sweep over
+ * all rows would:
+ *
+ *   center  row i, columns [i, n): the last column c whose average with x[i]
+ *           is <= t retreats as i grows; the sweep ends at the first row
+ *           without one (all later averages exceed that row's diagonal)
+ *   spread  row j, columns [0, j): the first column whose difference from
+ *           x[j] is <= t advances as j grows
+ *   shift   row i, columns [0, ny): the first y[j] with x[i] - y[j] <= t
+ *           advances as i grows (the sweep of shift_impl.c)
+ */
+#define SWEEP_ROWS(suffix, type, advance_gt, retreat_mid_gt)                             \
+    static void center_rows_##suffix(const type *x, int n, int r0, int r1, double t,     \
+                                     SweepCount *acc) {                                  \
+        double first = (double)x[r0];                                                    \
+        int lo = r0, hi = n;                                                             \
+        while (lo < hi) {                                                                \
+            int mid = lo + (hi - lo) / 2;                                                \
+            if (0.5 * first + 0.5 * (double)x[mid] > t) hi = mid; else lo = mid + 1;     \
+        }                                                                                \
+        int c = lo - 1;                                                                  \
+        for (int i = r0; i < r1; i++) {                                                  \
+            double row = (double)x[i];                                                   \
+            c = retreat_mid_gt(x, c, i, row, t);                                         \
+            int col = MAX(c + 1, i);                                                     \
+            double above = col < n ? 0.5 * row + 0.5 * (double)x[col] : INFINITY;        \
+            if (c < i) {                                                                 \
+                sweep_count_add(acc, 0, -INFINITY, above);                               \
+                break;                                                                   \
+            }                                                                            \
+            sweep_count_add(acc, c - i + 1, 0.5 * row + 0.5 * (double)x[c], above);      \
+        }                                                                                \
+    }                                                                                    \
+                                                                                         \
+    static void spread_rows_##suffix(const type *x, int n, int r0, int r1, double t,     \
+                                     SweepCount *acc) {                                  \
+        (void)n;                                                                         \
+        r0 = MAX(r0, 1);                                                                 \
+        if (r0 >= r1) return;                                                            \
+        double first = (double)x[r0];                                                    \
+        int lo = 0, hi = r0;                                                             \
+        while (lo < hi) {                                                                \
+            int mid = lo + (hi - lo) / 2;                                                \
+            if (first - (double)x[mid] > t) lo = mid + 1; else hi = mid;                 \
+        }                                                                                \
+        for (int j = r0; j < r1; j++) {                                                  \
+            double row = (double)x[j];                                                   \
+            lo = advance_gt(x, lo, j, row, t);                                           \
+            sweep_count_add(acc, j - lo, lo < j ? row - (double)x[lo] : -INFINITY,       \
+                            lo > 0 ? row - (double)x[lo - 1] : INFINITY);                \
+        }                                                                                \
+    }                                                                                    \
+                                                                                         \
+    static void shift_rows_##suffix(const type *x, const type *y, int ny, int r0,        \
+                                    int r1, double t, SweepCount *acc) {                 \
+        double first = (double)x[r0];                                                    \
+        int lo = 0, hi = ny;                                                             \
+        while (lo < hi) {                                                                \
+            int mid = lo + (hi - lo) / 2;                                                \
+            if (first - (double)y[mid] > t) lo = mid + 1; else hi = mid;                 \
+        }                                                                                \
+        for (int i = r0; i < r1; i++) {                                                  \
+            double row = (double)x[i];                                                   \
+            lo = advance_gt(y, lo, ny, row, t);                                          \
+            sweep_count_add(acc, ny - lo, lo < ny ? row - (double)y[lo] : -INFINITY,     \
+                            lo > 0 ? row - (double)y[lo - 1] : INFINITY);                \
+        }                                                                                \
+    }
+
+SWEEP_ROWS(double, double, count_advance_gt, count_retreat_mid_gt)
+SWEEP_ROWS(int, int, count_advance_gt_int, count_retreat_mid_gt_int)
+
+static void sweep_rows(const SweepPairs *pairs, int r0, int r1, double t, SweepCount *acc) {
+    acc->count_le = 0;
+    acc->below = -INFINITY;
+    acc->above = INFINITY;
+    if (r0 >= r1) return;
+    if (pairs->is_int) {
+        const int *x = (const int *)pairs->x;
+        switch (pairs->kind) {
+        case SWEEP_CENTER: center_rows_int(x, pairs->nx, r0, r1, t, acc); break;
+        case SWEEP_SPREAD: spread_rows_int(x, pairs->nx, r0, r1, t, acc); break;
+        case SWEEP_SHIFT: shift_rows_int(x, (const int *)pairs->y, pairs->ny, r0, r1, t, acc); break;
+        }
+    } else {
+        const double *x = (const double *)pairs->x;
+        switch (pairs->kind) {
+        case SWEEP_CENTER: center_rows_double(x, pairs->nx, r0, r1, t, acc); break;
+        case SWEEP_SPREAD: spread_rows_double(x, pairs->nx, r0, r1, t, acc); break;
+        case SWEEP_SHIFT:
+            shift_rows_double(x, (const double *)pairs->y, pairs->ny, r0, r1, t, acc);
+            break;
+        }
+    }
+}
+
+/* One sweep over all rows, split into blocks of rows on up to `threads` threads */
+static void sweep_count(const SweepPairs *pairs, double t, SweepCount *out) {
+    int rows = pairs->nx;
+    int blocks = MIN(MIN(pairs->threads, SWEEP_MAX_THREADS), rows >> 15);
+    if (blocks <= 1) {
+        sweep_rows(pairs, 0, rows, t, out);
+        return;
+    }
+
+    SweepCount parts[SWEEP_MAX_THREADS];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(blocks) schedule(static, 1)
+#endif
+    for (int block = 0; block < blocks; block++) {
+        int r0 = (int)((long long)rows * block / blocks);
+        int r1 = (int)((long long)rows * (block + 1) / blocks);
+        sweep_rows(pairs, r0, r1, t, &parts[block]);
+    }
+    *out = parts[0];
+    for (int block = 1; block < blocks; block++) {
+        sweep_count_add(out, parts[block].count_le, parts[block].below, parts[block].above);
+    }
+}
+
+/* Unsigned key with the order of the double (the bisection key of weighted_impl.c) */
+static inline uint64_t order_key(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits >> 63 ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+static inline double order_value(uint64_t key) {
+    uint64_t bits = key >> 63 ? key & ~((uint64_t)1 << 63) : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+long long sweep_total(const SweepPairs *pairs) {
+    long long n = pairs->nx;
+    switch (pairs->kind) {
+    case SWEEP_CENTER: return n * (n + 1) / 2;
+    case SWEEP_SPREAD: return n * (n - 1) / 2;
+    case SWEEP_SHIFT: return n * pairs->ny;
+    }
+    return 0;
+}
+
+static inline double sweep_value(const SweepPairs *pairs, const void *values, int i) {
+    return pairs->is_int ? (double)((const int *)values)[i] : ((const double *)values)[i];
+}
+
+int sweep_ranks_compute(const SweepPairs *pairs, const long long *ranks, int n_ranks, double *out,
+                        KernelStats *stats, KernelBudget *budget) {
+    if (n_ranks == 0) return SWEEP_OK;
+    long long total = sweep_total(pairs);
+
+    /* Full range: [min, max] pair value, or [0, max] for the differences of Spread */
+    int last = pairs->nx - 1;
+    double x_first = sweep_value(pairs, pairs->x, 0);
+    double x_last = sweep_value(pairs, pairs->x, last);
+    double range_min, range_max;
+    switch (pairs->kind) {
+    case SWEEP_CENTER:
+        range_min = 0.5 * x_first + 0.5 * x_first;
+        range_max = 0.5 * x_last + 0.5 * x_last;
+        break;
+    case SWEEP_SPREAD:
+        range_min = 0.0;
+        range_max = x_last - x_first;
+        break;
+    default:
+        range_min = x_first - sweep_value(pairs, pairs->y, pairs->ny - 1);
+        range_max = x_last - sweep_value(pairs, pairs->y, 0);
+        break;
+    }
+
+    SweepCount log[SWEEP_LOG_SIZE];
+    int log_size = 0;
+    int passes = 0;
+    int status = SWEEP_OK;
+
+    for (int r = 0; r < n_ranks && status == SWEEP_OK; r++) {
+        long long k = ranks[r];
+
+        /*
+         * Bracket [lo, hi] around the k-th value: count_lo values lie below lo
+         * and count_hi at or below hi. Earlier probes pin it: one with
+         * count_le >= k caps the value at its `below`, any other floors it at
+         * its `above`.
+         */
+        double lo = range_min, hi = range_max;
+        long long count_lo = 0, count_hi = total;
+        for (int i = 0; i < log_size; i++) {
+            if (log[i].count_le >= k) {
+                if (log[i].below < hi) {
+                    hi = log[i].below;
+                    count_hi = log[i].count_le;
+                }
+            } else if (log[i].above > lo) {
+                lo = log[i].above;
+                count_lo = log[i].count_le;
+            }
+        }
+
+        int interpolate = 1;
+        int iter = 0;
+        for (; iter < SWEEP_MAX_PASSES && lo != hi; iter++) {
+            status = kernel_budget_poll(budget);
+            if (status) break;
+            long long previous_width = count_hi - count_lo;
+
+            double t;
+            if (interpolate) {
+                double fraction = ((double)(k - count_lo) - 0.5) / (double)previous_width;
+                t = (1.0 - fraction) * lo + fraction * hi;
+            } else if (pairs->is_int) {
+                t = 0.5 * lo + 0.5 * hi;
+            } else {
+                uint64_t lo_key = order_key(lo);
+                t = order_value(lo_key + (order_key(hi) - lo_key) / 2);
+            }
+            // Any threshold in [lo, hi) discards at least one value
+            if (!(t >= lo && t < hi)) t = lo;
+
+            SweepCount probe;
+            sweep_count(pairs, t, &probe);
+            if (log_size < SWEEP_LOG_SIZE) log[log_size++] = probe;
+
+            if (probe.count_le >= k) {
+                hi = probe.below;
+                count_hi = probe.count_le;
+            } else {
+                lo = probe.above;
+                count_lo = probe.count_le;
+            }
+
+            // Interpolate again only while it keeps at least halving the rank interval
+            interpolate = 2 * (count_hi - count_lo) <= previous_width;
+        }
+
+        KERNEL_STATS_ADD(stats, passes, iter);
+        KERNEL_STATS_ADD(stats, sweeps, iter);
+        passes = MAX(passes, iter);
+        if (status == SWEEP_OK && lo != hi) status = SWEEP_NO_CONVERGENCE;
+        out[r] = lo;
+    }
+
+    if (stats && passes > stats->max_search_passes) stats->max_search_passes = passes;
+    return status;
+}
+
+int sweep_median_compute(const SweepPairs *pairs, double *out, KernelStats *stats,
+                         KernelBudget *budget) {
+    long long total = sweep_total(pairs);
+    if (total == 0) {
+        *out = 0.0;
+        return SWEEP_OK;
+    }
+
+    long long ranks[2] = { (total + 1) / 2, (total + 2) / 2 };
+    int n_ranks = ranks[0] < ranks[1] ? 2 : 1;
+    double values[2];
+    int status = sweep_ranks_compute(pairs, ranks, n_ranks, values, stats, budget);
+    if (status != SWEEP_OK) return status;
+
+    *out = n_ranks == 2 ? 0.5 * values[0] + 0.5 * values[1] : values[0];
+    return SWEEP_OK;
+}
@@ -0,0 +1,71 @@
+#ifndef SWEEP_SELECT_H
+#define SWEEP_SELECT_H
+
+#include "kernel_stats.h"
+#include "kernel_budget.h"
+
+/* Status codes of sweep_ranks_compute (they coincide with CENTER_* and SPREAD_*) */
+#define SWEEP_OK 0
+#define SWEEP_NO_CONVERGENCE 2
+
+/* Most threads one sweep splits its rows over */
+#define SWEEP_MAX_THREADS 256
+
+/* Passes after which a search gives up (only reachable on unsorted input) */
+#define SWEEP_MAX_PASSES 256
+
+/* Pair values a selection ranks */
+typedef enum {
+    SWEEP_CENTER, /* 0.5 * x[i] + 0.5 * x[j], i <= j: the n(n+1)/2 averages of Center */
+    SWEEP_SPREAD, /* x[j] - x[i], i < j: the n(n-1)/2 differences of Spread */
+    SWEEP_SHIFT   /* x[i] - y[j]: the nx * ny differences of Shift */
+} SweepKind;
+
+/*
+ * Sorted sample(s) whose pair values a selection ranks: `x` (and `y` for
+ * SWEEP_SHIFT) sorted ascending, NaN-free, read in place and never copied.
+ * With is_int they are const int * and every value is promoted to double
+ * before the pair arithmetic, which is then exact (the averages of Center
+ * are the same 0.5 * a + 0.5 * b as for the promoted double input).
+ * `threads` > 1 splits the sweeps of large samples over OpenMP threads; the
+ * result does not depend on it.
+ */
+typedef struct {
+    SweepKind kind;
+    int is_int;
+    const void *x;
+    int nx;
+    const void *y;
+    int ny;
+    int threads;
+} SweepPairs;
+
+/* Number of pair values of `pairs` */
+long long sweep_total(const SweepPairs *pairs);
+
+/*
+ * Constant-memory selection: out[i] receives the pair value of 1-based rank
+ * ranks[i] (ascending, within [1, sweep_total]). Each rank is a bracketed
+ * search whose probes are two-pointer counting sweeps over the rows, with
+ * thresholds interpolated on the bracket counts and a bisection fallback
+ * (of the value range for int input, whose pair values lie on a grid of
+ * halves, and of the bit patterns for doubles), so it ends after at most
+ * ~35 (int) or ~190 (double) sweeps; later ranks start from the tightest
+ * bracket the earlier probes pinned. Nothing is allocated and no per-row
+ * state is kept, so the footprint is O(1) beyond the samples themselves.
+ * Work is counted into `stats` and every sweep polls `budget`, unless NULL.
+ * Never raises an R error; returns SWEEP_OK, SWEEP_NO_CONVERGENCE or the
+ * budget's stopped status.
+ */
+int sweep_ranks_compute(const SweepPairs *pairs, const long long *ranks, int n_ranks, double *out,
+                        KernelStats *stats, KernelBudget *budget);
+
+/*
+ * Median of the pair values (0.5 * a + 0.5 * b of the two middle ranks when
+ * their number is even, 0 when there are none) through sweep_ranks_compute:
+ * Center for SWEEP_CENTER, Spread for SWEEP_SPREAD, Shift for SWEEP_SHIFT.
+ */
+int sweep_median_compute(const SweepPairs *pairs, double *out, KernelStats *stats,
+                         KernelBudget *budget);
+
+#endif
@@ -0,0 +1,471 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "weighted_impl.h"
+#include "count_kernels.h"
+#include "scratch_arena.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static inline double midpoint_w(double a, double b) {
+    return 0.5 * a + 0.5 * b;
+}
+
+typedef enum {
+    WEIGHTED_CENTER,  /* averages (rows[i] + rows[j]) / 2, i <= j */
+    WEIGHTED_SPREAD,  /* differences rows[j] - rows[i], i <= j */
+    WEIGHTED_SHIFT    /* differences rows[i] - cols[j] */
+} WeightedKind;
+
+/*
+ * The pairs of one weighted selection. A pair (i, j), i != j, weighs
+ * row_weights[i] times the weight of column j, and `col_prefix[j]` is the
+ * total weight of columns [0, j). For Center and Spread the columns are the
+ * rows, and the pair (i, i) weighs diag[i] instead (a zero diag drops it).
+ * Sweeps and search passes are counted into `stats`, and every search pass
+ * polls `budget`, unless NULL.
+ */
+typedef struct {
+    WeightedKind kind;
+    const double *rows;
+    const double *row_weights;
+    int n_rows;
+    const double *cols;
+    const double *col_prefix;
+    int n_cols;
+    const double *diag;
+    KernelStats *stats;
+    KernelBudget *budget;
+} WeightedPairs;
+
+/* Weight of the pairs at or below a threshold, and the pair values around it */
+typedef struct {
+    double weight_le;
+    double closest_below;
+    double closest_above;
+} WeightedProbe;
+
+/*
+ * Weighted two-pointer sweep: each row's pairs at or below `pivot` are a
+ * contiguous column range, so the row adds its weight times that range's
+ * prefix-sum weight. Rows always add their terms in the same order, so every
+ * probe of the same pair set reports bit-identical weights (and integer
+ * weights below 2^53 are summed exactly).
+ */
+static void weighted_sweep(const WeightedPairs *p, double pivot, WeightedProbe *probe) {
+    const double *v = p->rows;
+    const double *w = p->row_weights;
+    const double *prefix = p->col_prefix;
+    double weight = 0;
+    double closest_below = -INFINITY;
+    double closest_above = INFINITY;
+    KERNEL_STATS_ADD(p->stats, sweeps, 1);
+
+    if (p->kind == WEIGHTED_CENTER) {
+        int n = p->n_rows;
+        int c = n - 1;
+        for (int i = 0; i < n; i++) {
+            // Largest column c >= i whose average with row i is <= pivot
+            c = count_retreat_mid_gt(v, MAX(c, i - 1), i, v[i], pivot);
+            if (c >= i) {
+                weight += p->diag[i] + w[i] * (prefix[c + 1] - prefix[i + 1]);
+                closest_below = MAX(closest_below, midpoint_w(v[i], v[c]));
+            }
+            if (c + 1 < n) {
+                closest_above = MIN(closest_above, midpoint_w(v[i], v[c + 1]));
+            }
+        }
+    } else if (p->kind == WEIGHTED_SPREAD) {
+        int n = p->n_rows;
+        int e = 0;
+        for (int i = 0; i < n; i++) {
+            // First column e > i with v[e] - v[i] > pivot (v[i] - v[e] is its
+            // exact negation, so the kernel's x - y >= -pivot test is the same)
+            e = count_advance_ge(v, MAX(e, i + 1), n, v[i], -pivot);
+            if (e > i + 1) {
+                weight += w[i] * (prefix[e] - prefix[i + 1]);
+                closest_below = MAX(closest_below, v[e - 1] - v[i]);
+            }
+            if (e < n) {
+                closest_above = MIN(closest_above, v[e] - v[i]);
+            }
+            if (p->diag[i] > 0) {
+                if (pivot >= 0) {
+                    weight += p->diag[i];
+                    closest_below = MAX(closest_below, 0.0);
+                } else {
+                    closest_above = MIN(closest_above, 0.0);
+                }
+            }
+        }
+    } else {
+        const double *y = p->cols;
+        int n = p->n_cols;
+        double col_total = prefix[n];
+        int j = 0;
+        for (int i = 0; i < p->n_rows; i++) {
+            // First column j with x[i] - y[j] <= pivot
+            j = count_advance_gt(y, j, n, v[i], pivot);
+            weight += w[i] * (col_total - prefix[j]);
+            if (j < n) closest_below = MAX(closest_below, v[i] - y[j]);
+            if (j > 0) closest_above = MIN(closest_above, v[i] - y[j - 1]);
+        }
+    }
+
+    probe->weight_le = weight;
+    probe->closest_below = closest_below;
+    probe->closest_above = closest_above;
+}
+
+/*
+ * Bracket of a weighted search: pair values `lo` <= `hi` with the weight
+ * strictly below lo and at or below hi, and `above_hi`, the smallest pair
+ * value above hi (Inf when hi is the maximum).
+ */
+typedef struct {
+    double lo;
+    double weight_below_lo;
+    double hi;
+    double weight_le_hi;
+    double above_hi;
+} WeightedBracket;
+
+/* Bracket of every pair value: their minimum and maximum, and the total weight */
+static void weighted_bracket(const WeightedPairs *p, WeightedBracket *b) {
+    WeightedProbe all;
+    weighted_sweep(p, INFINITY, &all);
+    const double *v = p->rows;
+    int n = p->n_rows;
+
+    if (p->kind == WEIGHTED_CENTER) {
+        b->lo = v[0];
+        b->hi = v[n - 1];
+    } else if (p->kind == WEIGHTED_SPREAD) {
+        // Smallest difference: 0 when some value repeats, else the closest gap
+        double lo = INFINITY;
+        for (int i = 0; i < n; i++) {
+            if (p->diag[i] > 0) lo = 0;
+            if (i + 1 < n) lo = MIN(lo, v[i + 1] - v[i]);
+        }
+        b->lo = lo;
+        b->hi = n > 1 ? v[n - 1] - v[0] : 0;
+    } else {
+        b->lo = v[0] - p->cols[p->n_cols - 1];
+        b->hi = v[n - 1] - p->cols[0];
+    }
+    b->weight_below_lo = 0;
+    b->weight_le_hi = all.weight_le;
+    b->above_hi = INFINITY;
+}
+
+/*
+ * Doubles as unsigned integers in the same order (-0.0 just below +0.0), so
+ * the integer midpoint of two keys splits the doubles between them in half
+ */
+static inline uint64_t order_key(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits >> 63 ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+static inline double order_value(uint64_t key) {
+    uint64_t bits = key >> 63 ? key & ~((uint64_t)1 << 63) : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Passes that may interpolate; the rest bisect the bracket's doubles */
+#define WEIGHTED_INTERPOLATED_PASSES 64
+
+/*
+ * Narrows `b` (whose lo lies at or below the answer) to the smallest pair
+ * value whose cumulative weight reaches `target`, then b->lo == b->hi. As in
+ * the unweighted bracketed search of shift_impl.c, thresholds are interpolated
+ * on the bracket weights, falling back to a midpoint whenever a step fails to
+ * halve the weight interval.
+ *
+ * The midpoint is taken between the bit patterns of lo and hi, not their
+ * values: every such pass at least halves the number of doubles in the
+ * bracket (lo and hi are pair values, and the probe tightens one of them past
+ * the threshold), so 64 of them end any search, however many binades the
+ * pairs span. Interpolation is allowed for the first
+ * WEIGHTED_INTERPOLATED_PASSES passes only, which bounds the search by
+ * WEIGHTED_INTERPOLATED_PASSES + 65 passes; WEIGHTED_NO_CONVERGENCE is never
+ * returned on valid input.
+ */
+static int weighted_search(const WeightedPairs *p, double target, WeightedBracket *b) {
+    const int max_iterations = WEIGHTED_INTERPOLATED_PASSES + 65;
+    int interpolate = 1;
+
+    int iter = 0;
+    for (; iter < max_iterations && b->lo != b->hi; iter++) {
+        int stop = kernel_budget_poll(p->budget);
+        if (stop) return stop;
+        double previous_width = b->weight_le_hi - b->weight_below_lo;
+
+        double mid;
+        if (interpolate) {
+            double fraction = (target - b->weight_below_lo) / previous_width;
+            mid = (1.0 - fraction) * b->lo + fraction * b->hi;
+        } else {
+            uint64_t lo_key = order_key(b->lo);
+            mid = order_value(lo_key + (order_key(b->hi) - lo_key) / 2);
+        }
+        // Any threshold in [lo, hi) discards at least one pair value
+        if (!(mid >= b->lo && mid < b->hi)) {
+            mid = b->lo;
+        }
+
+        WeightedProbe probe;
+        weighted_sweep(p, mid, &probe);
+        if (probe.weight_le >= target) {
+            b->hi = probe.closest_below;
+            b->weight_le_hi = probe.weight_le;
+            b->above_hi = probe.closest_above;
+        } else {
+            b->lo = probe.closest_above;
+            b->weight_below_lo = probe.weight_le;
+        }
+
+        interpolate = iter + 1 < WEIGHTED_INTERPOLATED_PASSES &&
+                      2 * (b->weight_le_hi - b->weight_below_lo) <= previous_width;
+    }
+
+    KERNEL_STATS_ADD(p->stats, passes, iter);
+    if (p->stats && iter > p->stats->max_search_passes) p->stats->max_search_passes = iter;
+
+    return b->lo == b->hi ? WEIGHTED_OK : WEIGHTED_NO_CONVERGENCE;
+}
+
+/* Midpoint of the weighted median interval of the pairs */
+static int weighted_median(const WeightedPairs *p, double *out) {
+    WeightedBracket b;
+    weighted_bracket(p, &b);
+    double half = b.weight_le_hi / 2;
+
+    int status = weighted_search(p, half, &b);
+    if (status != WEIGHTED_OK) return status;
+
+    // The upper end is the same value unless exactly half the weight lies at
+    // or below it, in which case it is the next pair value
+    double upper = b.weight_le_hi > half ? b.hi : b.above_hi;
+    *out = midpoint_w(b.hi, upper);
+    return WEIGHTED_OK;
+}
+
+size_t weighted_work_size(int n) {
+    return 2 * scratch_align(((size_t)n + 1) * sizeof(double));
+}
+
+/* Column prefix sums of `weights` in `work`, followed by room for n diagonal weights */
+static double *weighted_prefix(const double *weights, int n, void *work) {
+    double *prefix = (double *)work;
+    prefix[0] = 0;
+    for (int i = 0; i < n; i++) {
+        prefix[i + 1] = prefix[i] + weights[i];
+    }
+    return prefix;
+}
+
+static inline double *weighted_diag(void *work, int n) {
+    return (double *)((char *)work + scratch_align(((size_t)n + 1) * sizeof(double)));
+}
+
+int weighted_center_compute_ws(const double *sorted_values, const double *weights, int n,
+                               int counts, void *work, double *out, KernelBudget *budget) {
+    double *prefix = weighted_prefix(weights, n, work);
+    double *diag = weighted_diag(work, n);
+    if (counts) {
+        // As in tie compression: c copies form c(c + 1) / 2 pairs i <= j
+        for (int i = 0; i < n; i++) diag[i] = weights[i] * (weights[i] + 1) / 2;
+    } else {
+        for (int i = 0; i < n; i++) diag[i] = weights[i] * weights[i];
+    }
+    WeightedPairs p = { WEIGHTED_CENTER, sorted_values, weights, n, sorted_values, prefix, n, diag, NULL, budget };
+    return weighted_median(&p, out);
+}
+
+int weighted_shift_compute_ws(const double *x, const double *x_weights, int m,
+                              const double *y, const double *y_weights, int n,
+                              void *work, double *out, KernelBudget *budget) {
+    double *prefix = weighted_prefix(y_weights, n, work);
+    WeightedPairs p = { WEIGHTED_SHIFT, x, x_weights, m, y, prefix, n, NULL, NULL, budget };
+    return weighted_median(&p, out);
+}
+
+/* ===== Tie compression ===== */
+
+int sorted_runs(const double *sorted_values, int n) {
+    int runs = n > 0;
+    for (int i = 1; i < n; i++) {
+        runs += sorted_values[i] != sorted_values[i - 1];
+    }
+    return runs;
+}
+
+int sorted_int_runs(const int *sorted_values, int n) {
+    int runs = n > 0;
+    for (int i = 1; i < n; i++) {
+        runs += sorted_values[i] != sorted_values[i - 1];
+    }
+    return runs;
+}
+
+size_t ties_work_size(int runs) {
+    return 2 * scratch_align((size_t)runs * sizeof(double)) + weighted_work_size(runs);
+}
+
+/*
+ * Distinct values of `sorted_values` (const int * when is_int, promoted here)
+ * and their multiplicities, carved from `work`; returns the slice after them.
+ * Every average and difference of the expanded input is formed, with the same
+ * operations, from the run values, so the order statistics are the same
+ * numbers (-0 and 0 share a run, so a zero result may carry the other sign).
+ */
+static void *ties_compress(const void *sorted_values, int is_int, int n, int runs, void *work,
+                           double **values, double **counts) {
+    char *cursor = (char *)work;
+    *values = (double *)cursor;
+    cursor += scratch_align((size_t)runs * sizeof(double));
+    *counts = (double *)cursor;
+    cursor += scratch_align((size_t)runs * sizeof(double));
+
+    const double *doubles = (const double *)sorted_values;
+    const int *ints = (const int *)sorted_values;
+    int k = -1;
+    for (int i = 0; i < n; i++) {
+        double value = is_int ? (double)ints[i] : doubles[i];
+        if (k < 0 || value != (*values)[k]) {
+            (*values)[++k] = value;
+            (*counts)[k] = 0;
+        }
+        (*counts)[k] += 1;
+    }
+    return cursor;
+}
+
+int ties_center_compute_ws(const void *sorted_values, int is_int, int n, int runs, void *work,
+                           double *out, KernelStats *stats, KernelBudget *budget) {
+    double *values, *counts;
+    void *rest = ties_compress(sorted_values, is_int, n, runs, work, &values, &counts);
+    double *prefix = weighted_prefix(counts, runs, rest);
+    double *diag = weighted_diag(rest, runs);
+    // c copies of one value form c(c + 1) / 2 pairs i <= j among themselves
+    for (int i = 0; i < runs; i++) diag[i] = counts[i] * (counts[i] + 1) / 2;
+    WeightedPairs p = { WEIGHTED_CENTER, values, counts, runs, values, prefix, runs, diag, stats, budget };
+    return weighted_median(&p, out);
+}
+
+int ties_spread_compute_ws(const void *sorted_values, int is_int, int n, int runs, void *work,
+                           double *out, KernelStats *stats, KernelBudget *budget) {
+    double *values, *counts;
+    void *rest = ties_compress(sorted_values, is_int, n, runs, work, &values, &counts);
+    double *prefix = weighted_prefix(counts, runs, rest);
+    double *diag = weighted_diag(rest, runs);
+    // c copies of one value form c(c - 1) / 2 pairs i < j, all at difference 0
+    for (int i = 0; i < runs; i++) diag[i] = counts[i] * (counts[i] - 1) / 2;
+    WeightedPairs p = { WEIGHTED_SPREAD, values, counts, runs, values, prefix, runs, diag, stats, budget };
+    return weighted_median(&p, out);
+}
+
+size_t ties_shift_work_size(int runs_x, int runs_y) {
+    return ties_work_size(runs_x) + ties_work_size(runs_y);
+}
+
+int ties_shift_ranks_ws(const void *x, int m, int runs_x, const void *y, int n, int runs_y,
+                        int is_int, const long long *ranks, int n_ranks, void *work, double *out,
+                        KernelStats *stats, KernelBudget *budget) {
+    double *x_values, *x_counts, *y_values, *y_counts;
+    char *y_work = (char *)work + ties_work_size(runs_x);
+    ties_compress(x, is_int, m, runs_x, work, &x_values, &x_counts);
+    void *rest = ties_compress(y, is_int, n, runs_y, y_work, &y_values, &y_counts);
+    double *prefix = weighted_prefix(y_counts, runs_y, rest);
+    WeightedPairs p = { WEIGHTED_SHIFT, x_values, x_counts, runs_x, y_values, prefix, runs_y, NULL, stats, budget };
+
+    // Ascending ranks: each search starts from the previous answer
+    WeightedBracket all;
+    weighted_bracket(&p, &all);
+    WeightedBracket b = all;
+    for (int i = 0; i < n_ranks; i++) {
+        b.hi = all.hi;
+        b.weight_le_hi = all.weight_le_hi;
+        b.above_hi = all.above_hi;
+        int status = weighted_search(&p, (double)ranks[i], &b);
+        if (status != WEIGHTED_OK) return status;
+        out[i] = b.lo;
+    }
+    return WEIGHTED_OK;
+}
+
+/* ===== R entry points ===== */
+
+/* Checks a (sorted values, positive weights) pair of R vectors; returns the length */
+static int weighted_input(SEXP values_sexp, SEXP weights_sexp) {
+    if (!isReal(values_sexp) || !isReal(weights_sexp)) {
+        error("values and weights must be numeric");
+    }
+    int n = length(values_sexp);
+    if (n == 0) {
+        error("Input vector cannot be empty");
+    }
+    if (length(weights_sexp) != n) {
+        error("weights length must match values length");
+    }
+    const double *weights = REAL(weights_sexp);
+    for (int i = 0; i < n; i++) {
+        if (!(weights[i] > 0) || !R_FINITE(weights[i])) {
+            error("weights must be positive and finite");
+        }
+    }
+    return n;
+}
+
+static SEXP weighted_result(int status, double value) {
+    if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+    if (status != WEIGHTED_OK) {
+        error("Convergence failure (pathological input)");
+    }
+    return ScalarReal(value);
+}
+
+/*
+ * R entry point: weighted Center of ascending `sorted_values` with positive
+ * `weights` (permuted alongside the values); with `counts_sexp` TRUE the
+ * weights are whole replication counts. The search stops at `deadline_sexp`
+ * (see kernel_budget.h).
+ */
+SEXP weighted_center_impl_c(SEXP sorted_sexp, SEXP weights_sexp, SEXP counts_sexp, SEXP deadline_sexp) {
+    int n = weighted_input(sorted_sexp, weights_sexp);
+    int counts = asLogical(counts_sexp) == TRUE;
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    void *work = r_scratch_reserve(weighted_work_size(n));
+    double result;
+    int status = weighted_center_compute_ws(REAL(sorted_sexp), REAL(weights_sexp), n,
+                                            counts, work, &result, &budget);
+    r_scratch_trim();
+    return weighted_result(status, result);
+}
+
+/*
+ * R entry point: weighted Shift of ascending x and y with positive weights
+ * (permuted alongside the values), stopping at `deadline_sexp`.
+ */
+SEXP weighted_shift_impl_c(SEXP x_sexp, SEXP x_weights_sexp, SEXP y_sexp, SEXP y_weights_sexp,
+                           SEXP deadline_sexp) {
+    int m = weighted_input(x_sexp, x_weights_sexp);
+    int n = weighted_input(y_sexp, y_weights_sexp);
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    void *work = r_scratch_reserve(weighted_work_size(n));
+    double result;
+    int status = weighted_shift_compute_ws(REAL(x_sexp), REAL(x_weights_sexp), m,
+                                           REAL(y_sexp), REAL(y_weights_sexp), n,
+                                           work, &result, &budget);
+    r_scratch_trim();
+    return weighted_result(status, result);
+}
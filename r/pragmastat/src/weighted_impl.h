@@ -0,0 +1,88 @@
+#ifndef WEIGHTED_IMPL_H
+#define WEIGHTED_IMPL_H
+
+#include <stddef.h>
+#include "kernel_stats.h"
+#include "kernel_budget.h"
+
+/* Status codes shared by the weighted kernels */
+#define WEIGHTED_OK 0
+#define WEIGHTED_NO_CONVERGENCE 2
+
+/*
+ * Weighted Center and Shift over sorted values with strictly positive weights.
+ * Every pair contributes the product of its two weights to the rank count
+ * (for Center, the pairs i <= j, so (i, i) weighs w_i^2), and the result is the
+ * midpoint of the weighted median interval: the smallest pair value whose
+ * cumulative weight reaches half the total, and the smallest whose cumulative
+ * weight exceeds it. With all weights equal this is exactly the unweighted
+ * estimator; for Shift, integer weights give the estimate of the replicated
+ * samples. For Center, w_i^2 on the diagonal is not replication (c copies of
+ * a value form c(c + 1) / 2 pairs i <= j, not c^2): nonzero `counts` weighs
+ * (i, i) as w_i(w_i + 1) / 2, so whole-number weights give the Center of the
+ * replicated sample.
+ *
+ * Touch no R API: `work` must hold weighted_work_size(n) bytes, where n is the
+ * length of the sample whose weight prefix sums are kept (the only sample for
+ * Center, y for Shift). Every search pass polls `budget` unless NULL. Return
+ * WEIGHTED_OK, WEIGHTED_NO_CONVERGENCE or the budget's stopped status.
+ */
+size_t weighted_work_size(int n);
+
+int weighted_center_compute_ws(const double *sorted_values, const double *weights, int n,
+                               int counts, void *work, double *out, KernelBudget *budget);
+
+int weighted_shift_compute_ws(const double *x, const double *x_weights, int m,
+                              const double *y, const double *y_weights, int n,
+                              void *work, double *out, KernelBudget *budget);
+
+/*
+ * Tie compression: heavily tied sorted input (e.g. quantized timings) runs the
+ * same weighted sweeps over its distinct values, with their multiplicities as
+ * weights and the pairs of copies of one value weighed as in the expanded
+ * input, so every result equals the uncompressed kernels' (up to the sign of
+ * a zero) while each sweep costs O(runs) instead of O(n). The input is
+ * const double *, or const int * with is_int (integer timings, promoted run
+ * by run, so only the distinct values become doubles). `runs` is
+ * sorted_runs() or sorted_int_runs() of the input; `stats` (NULL to skip)
+ * receives the sweep and search pass counts, and every search pass polls
+ * `budget` (NULL to skip).
+ */
+#define TIES_MIN_SIZE 4096
+
+/* Compress only when the values repeat at least 8 times on average */
+#define TIES_MAX_RUN_FRACTION 8
+
+/* Number of runs of equal values in ascending `sorted_values` */
+int sorted_runs(const double *sorted_values, int n);
+
+/* sorted_runs of ascending integer input */
+int sorted_int_runs(const int *sorted_values, int n);
+
+static inline int ties_compressible(int n, int runs) {
+    return n >= TIES_MIN_SIZE && (long long)runs * TIES_MAX_RUN_FRACTION <= n;
+}
+
+/* Scratch bytes of ties_center_compute_ws / ties_spread_compute_ws */
+size_t ties_work_size(int runs);
+
+/* Center (median of the averages i <= j) of n sorted values in `runs` runs */
+int ties_center_compute_ws(const void *sorted_values, int is_int, int n, int runs, void *work,
+                           double *out, KernelStats *stats, KernelBudget *budget);
+
+/* Spread (median of the differences i < j) of n sorted values in `runs` runs */
+int ties_spread_compute_ws(const void *sorted_values, int is_int, int n, int runs, void *work,
+                           double *out, KernelStats *stats, KernelBudget *budget);
+
+size_t ties_shift_work_size(int runs_x, int runs_y);
+
+/*
+ * Order statistics of the differences x[i] - y[j] of sorted x and y (both
+ * ints when is_int), for the ascending 1-based `ranks` into their m * n
+ * differences
+ */
+int ties_shift_ranks_ws(const void *x, int m, int runs_x, const void *y, int n, int runs_y,
+                        int is_int, const long long *ranks, int n_ranks, void *work, double *out,
+                        KernelStats *stats, KernelBudget *budget);
+
+#endif
@@ -0,0 +1,829 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernel_budget.h"
+#include "radix_sort.h"
+#include "scratch_arena.h"
+#include "sweep_select.h"
+
+/*
+ * Sliding window over the last `capacity` values of a stream, with Center and
+ * Spread maintained incrementally.
+ *
+ * The values are kept in arrival order (a ring buffer) and in an
+ * order-statistic tree of their distinct values with multiplicities. Each
+ * estimator also keeps a bracket [lo, hi] of pair values (averages for Center,
+ * differences for Spread) around its median: the number of pairs below lo,
+ * and a second order-statistic tree holding every pair value within [lo, hi]
+ * with its multiplicity. Inserting or evicting a value v adds or removes its
+ * pairs with the rest of the window. The pairs below lo are counted by one
+ * descent of the value tree, and the few that land in the bracket are added to
+ * the pair tree. A tick that changes k values therefore costs
+ * O(k (log W + pairs landing in the bracket)), about 2 * WINDOW_BRACKET_SPAN
+ * of them per value on average. A query then selects the median ranks in the
+ * pair tree in O(log W).
+ *
+ * The median rank moves as values come and go. When it leaves the bracket,
+ * the query selects the median ranks over the whole window, together with the
+ * bracket's new edge ranks, with the constant-memory sweeps of sweep_select.h,
+ * and rebuilds the bracket from them in O(W log W). That selection is the
+ * warm start of the following ticks. On
+ * random data the median drifts by about 0.4 W ranks per changed value, so a
+ * bracket of WINDOW_BRACKET_SPAN * W ranks on either side lasts for about
+ * (WINDOW_BRACKET_SPAN / 0.4)^2 changed values. Large pushes skip the
+ * incremental updates and rebuild at the next query.
+ *
+ * Every pair value is formed by the kernels' own arithmetic (0.5 * a + 0.5 * b
+ * for Center, larger - smaller for Spread), so the results are identical to
+ * center() and spread() of the window's values. -0 and 0 share a tree node, so
+ * a zero result may carry the other sign.
+ */
+
+/* Bracket half-width, in pair ranks per value in the window */
+#define WINDOW_BRACKET_SPAN 4
+
+/* Pushes of more than size / WINDOW_REBUILD_FRACTION values drop the brackets instead of updating them */
+#define WINDOW_REBUILD_FRACTION 16
+
+/* ===== Order-statistic tree (treap) of distinct values with multiplicities ===== */
+
+typedef struct {
+    double value;
+    long long count;   // multiplicity of the value
+    long long weight;  // total multiplicity of the subtree
+    int left;
+    int right;
+    uint32_t priority;
+} WindowNode;
+
+/* Nodes live in one growable pool; -1 is the empty tree, and freed nodes are chained through `left` */
+typedef struct {
+    WindowNode *nodes;
+    int capacity;
+    int used;
+    int free_list;
+    int root;
+    uint32_t seed;
+} WindowTree;
+
+static void tree_init(WindowTree *tree, uint32_t seed) {
+    memset(tree, 0, sizeof(*tree));
+    tree->free_list = -1;
+    tree->root = -1;
+    tree->seed = seed;
+}
+
+static void tree_clear(WindowTree *tree) {
+    tree->used = 0;
+    tree->free_list = -1;
+    tree->root = -1;
+}
+
+static void tree_free(WindowTree *tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->capacity = 0;
+    tree_clear(tree);
+}
+
+/* Room for `count` nodes; 0 when out of memory */
+static int tree_reserve(WindowTree *tree, int count) {
+    if (count <= tree->capacity) return 1;
+    int capacity = tree->capacity > 0 ? tree->capacity : 64;
+    while (capacity < count) capacity = capacity > INT_MAX / 2 ? INT_MAX : 2 * capacity;
+    WindowNode *nodes = (WindowNode *) realloc(tree->nodes, (size_t)capacity * sizeof(WindowNode));
+    if (!nodes) return 0;
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+    return 1;
+}
+
+/* xorshift32: node priorities only need to be independent of the values */
+static uint32_t tree_priority(WindowTree *tree) {
+    uint32_t x = tree->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tree->seed = x;
+    return x;
+}
+
+/* A fresh leaf, or -1 when out of memory */
+static int tree_node(WindowTree *tree, double value, long long count) {
+    int node = tree->free_list;
+    if (node >= 0) {
+        tree->free_list = tree->nodes[node].left;
+    } else {
+        if (tree->used == INT_MAX || !tree_reserve(tree, tree->used + 1)) return -1;
+        node = tree->used++;
+    }
+    WindowNode *leaf = &tree->nodes[node];
+    leaf->value = value;
+    leaf->count = count;
+    leaf->weight = count;
+    leaf->left = -1;
+    leaf->right = -1;
+    leaf->priority = tree_priority(tree);
+    return node;
+}
+
+static inline long long tree_weight(const WindowTree *tree, int node) {
+    return node < 0 ? 0 : tree->nodes[node].weight;
+}
+
+static inline void tree_update(WindowTree *tree, int node) {
+    WindowNode *x = &tree->nodes[node];
+    x->weight = x->count + tree_weight(tree, x->left) + tree_weight(tree, x->right);
+}
+
+/* Joins two treaps whose values all order `a` before `b` */
+static int tree_join(WindowTree *tree, int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (tree->nodes[a].priority > tree->nodes[b].priority) {
+        tree->nodes[a].right = tree_join(tree, tree->nodes[a].right, b);
+        tree_update(tree, a);
+        return a;
+    }
+    tree->nodes[b].left = tree_join(tree, a, tree->nodes[b].left);
+    tree_update(tree, b);
+    return b;
+}
+
+/*
+ * Adds `delta` copies of `value` under `node` (removing the value once its
+ * count reaches 0); returns the new subtree root. Sets *failed when out of
+ * memory or when removing copies the tree does not hold.
+ */
+static int tree_add_at(WindowTree *tree, int node, double value, long long delta, int *failed) {
+    if (node < 0) {
+        int leaf = delta > 0 ? tree_node(tree, value, delta) : -1;
+        if (leaf < 0) *failed = 1;
+        return leaf;
+    }
+    WindowNode *x = &tree->nodes[node];
+    if (value == x->value) {
+        x->count += delta;
+        if (x->count < 0) *failed = 1;
+        if (x->count <= 0) {
+            int joined = tree_join(tree, x->left, x->right);
+            tree->nodes[node].left = tree->free_list;
+            tree->free_list = node;
+            return joined;
+        }
+        tree_update(tree, node);
+        return node;
+    }
+    if (value < x->value) {
+        int child = tree_add_at(tree, x->left, value, delta, failed);
+        tree->nodes[node].left = child;
+        if (child >= 0 && tree->nodes[child].priority > tree->nodes[node].priority) {
+            // Rotate right
+            tree->nodes[node].left = tree->nodes[child].right;
+            tree_update(tree, node);
+            tree->nodes[child].right = node;
+            tree_update(tree, child);
+            return child;
+        }
+    } else {
+        int child = tree_add_at(tree, x->right, value, delta, failed);
+        tree->nodes[node].right = child;
+        if (child >= 0 && tree->nodes[child].priority > tree->nodes[node].priority) {
+            // Rotate left
+            tree->nodes[node].right = tree->nodes[child].left;
+            tree_update(tree, node);
+            tree->nodes[child].left = node;
+            tree_update(tree, child);
+            return child;
+        }
+    }
+    tree_update(tree, node);
+    return node;
+}
+
+/* Adds `delta` (possibly negative) copies of `value`; 0 on failure, which leaves the tree unusable */
+static int tree_add(WindowTree *tree, double value, long long delta) {
+    int failed = 0;
+    tree->root = tree_add_at(tree, tree->root, value, delta, &failed);
+    return !failed;
+}
+
+/* Value of 1-based rank `rank` (counting multiplicities), within [1, total weight] */
+static double tree_select(const WindowTree *tree, long long rank) {
+    int node = tree->root;
+    for (;;) {
+        const WindowNode *x = &tree->nodes[node];
+        long long left = tree_weight(tree, x->left);
+        if (rank <= left) {
+            node = x->left;
+        } else if (rank <= left + x->count) {
+            return x->value;
+        } else {
+            rank -= left + x->count;
+            node = x->right;
+        }
+    }
+}
+
+/*
+ * Weight of the values for which `holds` is true, when it holds for a prefix
+ * of the ascending values (and so on whole nodes): one root-to-leaf descent.
+ */
+typedef struct WindowProbe WindowProbe;
+typedef int (*WindowPredicate)(double x, const WindowProbe *probe);
+
+struct WindowProbe {
+    double v;          // the value being inserted or evicted
+    double threshold;  // a bracket edge
+};
+
+static long long tree_count_prefix(const WindowTree *tree, WindowPredicate holds, const WindowProbe *probe) {
+    long long count = 0;
+    int node = tree->root;
+    while (node >= 0) {
+        const WindowNode *x = &tree->nodes[node];
+        if (holds(x->value, probe)) {
+            count += tree_weight(tree, x->left) + x->count;
+            node = x->right;
+        } else {
+            node = x->left;
+        }
+    }
+    return count;
+}
+
+/*
+ * Calls `visit` on every node whose copies occupy the 1-based ranks
+ * (from, to] of the tree, where `from` and `to` fall on node boundaries;
+ * `offset` is the weight before the subtree.
+ */
+typedef int (*WindowVisit)(double value, long long count, void *context);
+
+static int tree_visit_range(const WindowTree *tree, int node, long long offset, long long from, long long to,
+                            WindowVisit visit, void *context) {
+    while (node >= 0) {
+        const WindowNode *x = &tree->nodes[node];
+        long long begin = offset + tree_weight(tree, x->left);
+        if (from < begin && !tree_visit_range(tree, x->left, offset, from, to, visit, context)) return 0;
+        if (begin >= to) return 1;
+        if (begin >= from && !visit(x->value, x->count, context)) return 0;
+        offset = begin + x->count;
+        node = x->right;
+    }
+    return 1;
+}
+
+/* In-order values and multiplicities of the tree into `values` and `counts`; returns their number */
+static int tree_runs_at(const WindowTree *tree, int node, double *values, long long *counts, int at) {
+    while (node >= 0) {
+        const WindowNode *x = &tree->nodes[node];
+        at = tree_runs_at(tree, x->left, values, counts, at);
+        values[at] = x->value;
+        counts[at] = x->count;
+        at++;
+        node = x->right;
+    }
+    return at;
+}
+
+static long long tree_build_weights(WindowTree *tree, int node) {
+    if (node < 0) return 0;
+    WindowNode *x = &tree->nodes[node];
+    x->weight = x->count + tree_build_weights(tree, x->left) + tree_build_weights(tree, x->right);
+    return x->weight;
+}
+
+/*
+ * Replaces the tree with the m ascending distinct `values` and their
+ * `counts` in O(m): the Cartesian tree of random priorities, built along its
+ * right spine. `spine` must hold m ints. 0 when out of memory (tree empty).
+ */
+static int tree_build(WindowTree *tree, const double *values, const long long *counts, int m, int *spine) {
+    tree_clear(tree);
+    if (!tree_reserve(tree, m)) return 0;
+    int depth = 0;
+    for (int i = 0; i < m; i++) {
+        int node = tree_node(tree, values[i], counts[i]);
+        int last = -1;
+        while (depth > 0 && tree->nodes[spine[depth - 1]].priority < tree->nodes[node].priority) {
+            last = spine[--depth];
+        }
+        tree->nodes[node].left = last;
+        if (depth > 0) tree->nodes[spine[depth - 1]].right = node;
+        spine[depth++] = node;
+    }
+    tree->root = m > 0 ? spine[0] : -1;
+    tree_build_weights(tree, tree->root);
+    return 1;
+}
+
+/* ===== Window state ===== */
+
+typedef enum {
+    WINDOW_CENTER,  // averages 0.5 * a + 0.5 * b of the pairs i <= j
+    WINDOW_SPREAD   // differences larger - smaller of the pairs i < j
+} WindowKind;
+
+/* Pair values of one estimator in [lo, hi], and how many lie below lo */
+typedef struct {
+    WindowKind kind;
+    int valid;
+    double lo;
+    double hi;
+    long long below;
+    WindowTree pairs;
+} WindowBracket;
+
+typedef struct {
+    int capacity;
+    int size;
+    int head;               // ring index of the oldest value
+    double *ring;           // arrival order
+    WindowTree values;      // distinct values with multiplicities
+    WindowBracket center;
+    WindowBracket spread;
+    ScratchArena arena;     // rebuild scratch: window values and selection work
+    ScratchArena pair_arena; // rebuild scratch: the bracket's pair values
+    int busy;               // a rebuild is running (see window_get)
+} SlidingWindow;
+
+static inline double window_average(double a, double b) {
+    return 0.5 * a + 0.5 * b;
+}
+
+static void bracket_drop(WindowBracket *bracket) {
+    bracket->valid = 0;
+    tree_clear(&bracket->pairs);
+}
+
+/* ----- Incremental updates ----- */
+
+static int center_below(double x, const WindowProbe *p) { return window_average(p->v, x) < p->threshold; }
+static int center_at_or_below(double x, const WindowProbe *p) { return window_average(p->v, x) <= p->threshold; }
+static int spread_smaller(double x, const WindowProbe *p) { return x < p->v; }
+static int spread_smaller_above(double x, const WindowProbe *p) { return x < p->v && p->v - x > p->threshold; }
+static int spread_smaller_at_or_above(double x, const WindowProbe *p) { return x < p->v && p->v - x >= p->threshold; }
+static int spread_larger_below(double x, const WindowProbe *p) { return x < p->v || x - p->v < p->threshold; }
+static int spread_larger_at_or_below(double x, const WindowProbe *p) { return x < p->v || x - p->v <= p->threshold; }
+
+/* Pairs of v with the partner nodes visited, added to (sign 1) or removed from (sign -1) the bracket */
+typedef struct {
+    WindowBracket *bracket;
+    double v;
+    long long sign;
+} WindowPairing;
+
+static int pair_center(double x, long long count, void *context) {
+    WindowPairing *p = (WindowPairing *)context;
+    return tree_add(&p->bracket->pairs, window_average(p->v, x), p->sign * count);
+}
+
+static int pair_spread(double x, long long count, void *context) {
+    WindowPairing *p = (WindowPairing *)context;
+    return tree_add(&p->bracket->pairs, x < p->v ? p->v - x : x - p->v, p->sign * count);
+}
+
+/*
+ * Adds (sign 1) or removes (sign -1) the pairs of one copy of `v` with the
+ * values in `partners` (the window without that copy), and for Center the pair
+ * of the copy with itself. Drops the bracket when the pair tree fails.
+ */
+static void bracket_pair(WindowBracket *bracket, const WindowTree *partners, double v, long long sign) {
+    if (!bracket->valid) return;
+    WindowPairing pairing = { bracket, v, sign };
+    WindowProbe lo = { v, bracket->lo };
+    WindowProbe hi = { v, bracket->hi };
+    int ok = 1;
+
+    if (bracket->kind == WINDOW_CENTER) {
+        // Averages with v rise with the partner
+        long long first = tree_count_prefix(partners, center_below, &lo);
+        long long last = tree_count_prefix(partners, center_at_or_below, &hi);
+        bracket->below += sign * first;
+        ok = tree_visit_range(partners, partners->root, 0, first, last, pair_center, &pairing);
+        double self = window_average(v, v);
+        if (self < bracket->lo) {
+            bracket->below += sign;
+        } else if (ok && self <= bracket->hi) {
+            ok = tree_add(&bracket->pairs, self, sign);
+        }
+    } else {
+        // Differences with v fall over the smaller partners and rise over the others
+        long long smaller = tree_count_prefix(partners, spread_smaller, &lo);
+        long long first = tree_count_prefix(partners, spread_smaller_above, &hi);
+        long long last = tree_count_prefix(partners, spread_smaller_at_or_above, &lo);
+        bracket->below += sign * (smaller - last);
+        ok = tree_visit_range(partners, partners->root, 0, first, last, pair_spread, &pairing);
+        first = tree_count_prefix(partners, spread_larger_below, &lo);
+        last = tree_count_prefix(partners, spread_larger_at_or_below, &hi);
+        bracket->below += sign * (first - smaller);
+        ok = ok && tree_visit_range(partners, partners->root, 0, first, last, pair_spread, &pairing);
+    }
+    if (!ok) bracket_drop(bracket);
+}
+
+/* Inserts one value; 0 when out of memory */
+static int window_insert(SlidingWindow *window, double v) {
+    bracket_pair(&window->center, &window->values, v, 1);
+    bracket_pair(&window->spread, &window->values, v, 1);
+    return tree_add(&window->values, v, 1);
+}
+
+static void window_evict(SlidingWindow *window, double v) {
+    tree_add(&window->values, v, -1);
+    bracket_pair(&window->center, &window->values, v, -1);
+    bracket_pair(&window->spread, &window->values, v, -1);
+}
+
+/* ----- Rebuild from a full selection ----- */
+
+/* Number of pairs of the kind over n values */
+static long long window_total(WindowKind kind, int n) {
+    return kind == WINDOW_CENTER ? (long long)n * (n + 1) / 2 : (long long)n * (n - 1) / 2;
+}
+
+/* First run index in [from, runs) whose pair value with run `row` is >= (or > when strict) t */
+static int runs_search(WindowKind kind, const double *values, int row, int from, int runs, double t, int strict) {
+    double base = values[row];
+    int lo = from, hi = runs;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        double pair = kind == WINDOW_CENTER ? window_average(base, values[mid]) : values[mid] - base;
+        if (strict ? pair <= t : pair < t) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Walks the pairs of the runs (values, counts) of the window run by run:
+ * counts those below lo into *below and, when `pair_values` is not NULL,
+ * stores each distinct (row, column) pair value within [lo, hi] with its
+ * multiplicity. Returns the number of such pair values.
+ */
+static long long bracket_walk(const WindowBracket *bracket, const double *values, const long long *counts,
+                              const long long *prefix, int runs, long long *below,
+                              double *pair_values, long long *pair_counts) {
+    WindowKind kind = bracket->kind;
+    long long stored = 0;
+    *below = 0;
+    for (int row = 0; row < runs; row++) {
+        long long c = counts[row];
+        // The pairs among the copies of one value: c(c + 1) / 2 averages, c(c - 1) / 2 zero differences
+        long long own = kind == WINDOW_CENTER ? c * (c + 1) / 2 : c * (c - 1) / 2;
+        double own_value = kind == WINDOW_CENTER ? window_average(values[row], values[row]) : 0.0;
+        if (own > 0) {
+            if (own_value < bracket->lo) {
+                *below += own;
+            } else if (own_value <= bracket->hi) {
+                if (pair_values) {
+                    pair_values[stored] = own_value;
+                    pair_counts[stored] = own;
+                }
+                stored++;
+            }
+        }
+
+        int first = runs_search(kind, values, row, row + 1, runs, bracket->lo, 0);
+        int last = runs_search(kind, values, row, first, runs, bracket->hi, 1);
+        *below += c * (prefix[first] - prefix[row + 1]);
+        if (pair_values) {
+            for (int column = first; column < last; column++) {
+                pair_values[stored + column - first] = kind == WINDOW_CENTER
+                    ? window_average(values[row], values[column])
+                    : values[column] - values[row];
+                pair_counts[stored + column - first] = c * counts[column];
+            }
+        }
+        stored += last - first;
+    }
+    return stored;
+}
+
+static void *window_scratch(SlidingWindow *window, ScratchArena *arena, size_t bytes) {
+    void *work = scratch_arena_reserve(arena, bytes);
+    if (!work) {
+        window->busy = 0;
+        error("sliding window: memory allocation failed");
+    }
+    return work;
+}
+
+/*
+ * Selects the median of the window's pairs together with the ranks
+ * WINDOW_BRACKET_SPAN * n away on either side, and rebuilds the bracket
+ * between those two. Returns the selection status (SWEEP_OK, also when the
+ * bracket could not be stored); *out receives the median.
+ */
+static int bracket_rebuild(SlidingWindow *window, WindowBracket *bracket, int threads, KernelBudget *budget,
+                           double *out) {
+    bracket_drop(bracket);
+    int n = window->size;
+    long long total = window_total(bracket->kind, n);
+    long long span = (long long)WINDOW_BRACKET_SPAN * n;
+    long long k_low = (total + 1) / 2;
+    long long k_high = (total + 2) / 2;
+    long long ranks[4] = { k_low - span < 1 ? 1 : k_low - span, k_low, k_high,
+                           k_high + span > total ? total : k_high + span };
+    double rank_values[4];
+
+    // The window expanded, and as runs with the prefix sums of their counts
+    int runs = window->values.used;
+    size_t sorted_bytes = scratch_align((size_t)n * sizeof(double));
+    size_t run_bytes = scratch_align((size_t)runs * sizeof(double));
+    char *work = (char *)window_scratch(window, &window->arena, sorted_bytes + 2 * run_bytes +
+                                        (size_t)(runs + 1) * sizeof(long long));
+    double *sorted = (double *)work;
+    double *values = (double *)(work + sorted_bytes);
+    long long *counts = (long long *)(work + sorted_bytes + run_bytes);
+    long long *prefix = (long long *)(work + sorted_bytes + 2 * run_bytes);
+
+    runs = tree_runs_at(&window->values, window->values.root, values, counts, 0);
+    prefix[0] = 0;
+    for (int i = 0, at = 0; i < runs; i++) {
+        for (long long copy = 0; copy < counts[i]; copy++) sorted[at++] = values[i];
+        prefix[i + 1] = prefix[i] + counts[i];
+    }
+
+    // The constant-memory sweeps: far apart ranks cost the Monahan selection
+    // one diverged group each
+    SweepPairs pairs = { bracket->kind == WINDOW_CENTER ? SWEEP_CENTER : SWEEP_SPREAD, 0, sorted, n, NULL, 0,
+                         threads };
+    int status = sweep_ranks_compute(&pairs, ranks, 4, rank_values, NULL, budget);
+    if (status != SWEEP_OK) return status;
+    *out = k_low == k_high ? rank_values[1] : window_average(rank_values[1], rank_values[2]);
+
+    bracket->lo = rank_values[0];
+    bracket->hi = rank_values[3];
+    long long stored = bracket_walk(bracket, values, counts, prefix, runs, &bracket->below, NULL, NULL);
+    if (stored > INT_MAX) return SWEEP_OK;
+
+    // Pair values and multiplicities, sorted and merged into the pair tree
+    int m = (int)stored;
+    size_t value_bytes = scratch_align((size_t)m * sizeof(double));
+    size_t count_bytes = scratch_align((size_t)m * sizeof(long long));
+    size_t sort_bytes = sort_weighted_work_size(m);
+    size_t spine_bytes = (size_t)m * sizeof(int);
+    char *pair_work = (char *)window_scratch(window, &window->pair_arena, value_bytes + count_bytes +
+                                             (sort_bytes > spine_bytes ? sort_bytes : spine_bytes));
+    double *pair_values = (double *)pair_work;
+    long long *pair_counts = (long long *)(pair_work + value_bytes);
+    void *rest = pair_work + value_bytes + count_bytes;
+    bracket_walk(bracket, values, counts, prefix, runs, &bracket->below, pair_values, pair_counts);
+    sort_weighted_doubles(pair_values, pair_counts, m, rest);
+    int distinct = 0;
+    for (int i = 0; i < m; i++) {
+        if (distinct > 0 && pair_values[i] == pair_values[distinct - 1]) {
+            pair_counts[distinct - 1] += pair_counts[i];
+        } else {
+            pair_values[distinct] = pair_values[i];
+            pair_counts[distinct] = pair_counts[i];
+            distinct++;
+        }
+    }
+    // Without memory for the tree the bracket stays dropped and the next query selects again
+    bracket->valid = tree_build(&bracket->pairs, pair_values, pair_counts, distinct, (int *)rest);
+    return SWEEP_OK;
+}
+
+/* Median of the bracket's pairs, rebuilding it when the median ranks lie outside */
+static double bracket_median(SlidingWindow *window, WindowBracket *bracket, int threads, KernelBudget *budget) {
+    long long total = window_total(bracket->kind, window->size);
+    if (total == 0) return 0.0;
+    long long k_low = (total + 1) / 2;
+    long long k_high = (total + 2) / 2;
+    if (bracket->valid && bracket->below < k_low &&
+        k_high <= bracket->below + tree_weight(&bracket->pairs, bracket->pairs.root)) {
+        double low = tree_select(&bracket->pairs, k_low - bracket->below);
+        if (k_low == k_high) return low;
+        return window_average(low, tree_select(&bracket->pairs, k_high - bracket->below));
+    }
+
+    double result = 0.0;
+    window->busy = 1;
+    int status = bracket_rebuild(window, bracket, threads, budget, &result);
+    window->busy = 0;
+    scratch_arena_trim(&window->arena);
+    scratch_arena_trim(&window->pair_arena);
+    if (status != SWEEP_OK) {
+        bracket_drop(bracket);
+        if (kernel_budget_stopped(status)) kernel_budget_fail(status);
+        error("Convergence failure (pathological input)");
+    }
+    return result;
+}
+
+/* ===== R entry points ===== */
+
+static void window_free(SlidingWindow *window) {
+    if (!window) return;
+    free(window->ring);
+    tree_free(&window->values);
+    tree_free(&window->center.pairs);
+    tree_free(&window->spread.pairs);
+    scratch_arena_free(&window->arena);
+    scratch_arena_free(&window->pair_arena);
+    free(window);
+}
+
+static void window_finalize(SEXP ptr) {
+    window_free((SlidingWindow *) R_ExternalPtrAddr(ptr));
+    R_ClearExternalPtr(ptr);
+}
+
+static SlidingWindow *window_get(SEXP ptr) {
+    if (TYPEOF(ptr) != EXTPTRSXP) {
+        error("invalid sliding window");
+    }
+    SlidingWindow *window = (SlidingWindow *) R_ExternalPtrAddr(ptr);
+    if (!window) {
+        error("invalid sliding window");
+    }
+    // The rebuild's interrupt check may run R code that calls back into this
+    // window, while its selection reads the window's trees and scratch
+    if (window->busy) {
+        error("sliding window is in use by a running query");
+    }
+    return window;
+}
+
+/*
+ * Creates an empty window of `capacity_sexp` values.
+ *
+ * @param capacity_sexp Integer: window length W
+ * @return External pointer to the window state
+ */
+SEXP window_new_c(SEXP capacity_sexp) {
+    int capacity = asInteger(capacity_sexp);
+    if (capacity == NA_INTEGER || capacity < 1) {
+        error("capacity must be a positive integer");
+    }
+
+    SlidingWindow *window = (SlidingWindow *) calloc(1, sizeof(SlidingWindow));
+    if (window) {
+        tree_init(&window->values, 0x9e3779b9u);
+        tree_init(&window->center.pairs, 0x85ebca6bu);
+        tree_init(&window->spread.pairs, 0xc2b2ae35u);
+        window->center.kind = WINDOW_CENTER;
+        window->spread.kind = WINDOW_SPREAD;
+        window->ring = (double *) malloc((size_t)capacity * sizeof(double));
+    }
+    if (!window || !window->ring) {
+        window_free(window);
+        error("sliding window: memory allocation failed");
+    }
+    window->capacity = capacity;
+
+    SEXP ptr = PROTECT(R_MakeExternalPtr(window, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, window_finalize, TRUE);
+    UNPROTECT(1);
+    return ptr;
+}
+
+/*
+ * Appends finite values to the window, evicting the oldest ones beyond its
+ * capacity, and updates the estimators' brackets value by value (large pushes
+ * drop them instead; the next query rebuilds them).
+ *
+ * @param ptr Window external pointer
+ * @param values_sexp Numeric vector of finite values, in arrival order
+ * @return The window external pointer, invisibly on the R side
+ */
+SEXP window_push_c(SEXP ptr, SEXP values_sexp) {
+    SlidingWindow *window = window_get(ptr);
+    if (!isReal(values_sexp)) {
+        error("values must be a numeric vector");
+    }
+    int k = length(values_sexp);
+    const double *values = REAL(values_sexp);
+    for (int i = 0; i < k; i++) {
+        if (!R_FINITE(values[i])) {
+            error("values must be finite");
+        }
+    }
+
+    int capacity = window->capacity;
+    if (k >= capacity) {
+        // Only the last `capacity` values survive
+        values += k - capacity;
+        k = capacity;
+        window->size = 0;
+        window->head = 0;
+        tree_clear(&window->values);
+    }
+    if ((long long)k * WINDOW_REBUILD_FRACTION > window->size) {
+        bracket_drop(&window->center);
+        bracket_drop(&window->spread);
+    }
+    if (!tree_reserve(&window->values, window->size + k)) {
+        error("sliding window: memory allocation failed");
+    }
+
+    for (int i = 0; i < k; i++) {
+        double value = values[i];
+        if (window->size == capacity) {
+            window_evict(window, window->ring[window->head]);
+            window->ring[window->head] = value;
+            window->head = (window->head + 1) % capacity;
+        } else {
+            window->ring[(window->head + window->size) % capacity] = value;
+            window->size++;
+        }
+        // The value tree has room for every value, so this insert cannot fail
+        window_insert(window, value);
+    }
+    return ptr;
+}
+
+/*
+ * Values currently in the window.
+ *
+ * @param ptr Window external pointer
+ * @param sorted_sexp Logical: ascending order if TRUE, arrival order otherwise
+ * @return Numeric vector of length size
+ */
+SEXP window_values_c(SEXP ptr, SEXP sorted_sexp) {
+    SlidingWindow *window = window_get(ptr);
+    int size = window->size;
+    SEXP result = PROTECT(allocVector(REALSXP, size));
+    double *out = REAL(result);
+    if (asLogical(sorted_sexp)) {
+        int runs = window->values.used;
+        size_t run_bytes = scratch_align((size_t)runs * sizeof(double));
+        char *work = (char *)window_scratch(window, &window->arena, 2 * run_bytes);
+        double *values = (double *)work;
+        long long *counts = (long long *)(work + run_bytes);
+        runs = tree_runs_at(&window->values, window->values.root, values, counts, 0);
+        for (int i = 0, at = 0; i < runs; i++) {
+            for (long long copy = 0; copy < counts[i]; copy++) out[at++] = values[i];
+        }
+        scratch_arena_trim(&window->arena);
+    } else {
+        for (int i = 0; i < size; i++) {
+            out[i] = window->ring[(window->head + i) % window->capacity];
+        }
+    }
+    UNPROTECT(1);
+    return result;
+}
+
+static int window_threads(SEXP threads_sexp) {
+    int threads = asInteger(threads_sexp);
+    if (threads == NA_INTEGER || threads < 1) {
+        error("threads must be a positive integer");
+    }
+    return threads;
+}
+
+/*
+ * Center of the values in the window, from its bracket when the median ranks
+ * lie in it, else from a selection that rebuilds it. The caller checks that
+ * the window is not empty.
+ *
+ * @param ptr Window external pointer
+ * @param threads_sexp Integer: number of threads for the selection passes
+ * @param deadline_sexp Numeric: deadline of the selection (see kernel_budget.h)
+ * @return Numeric scalar
+ */
+SEXP window_center_c(SEXP ptr, SEXP threads_sexp, SEXP deadline_sexp) {
+    SlidingWindow *window = window_get(ptr);
+    int threads = window_threads(threads_sexp);
+    if (window->size == 0) {
+        error("Input vector cannot be empty");
+    }
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    return ScalarReal(bracket_median(window, &window->center, threads, &budget));
+}
+
+/*
+ * Spread of the values in the window, as window_center_c computes Center.
+ * The sparity check (spread > 0) is left to the caller.
+ *
+ * @param ptr Window external pointer
+ * @param threads_sexp Integer: number of threads for the selection passes
+ * @param deadline_sexp Numeric: deadline of the selection (see kernel_budget.h)
+ * @return Numeric scalar
+ */
+SEXP window_spread_c(SEXP ptr, SEXP threads_sexp, SEXP deadline_sexp) {
+    SlidingWindow *window = window_get(ptr);
+    int threads = window_threads(threads_sexp);
+    if (window->size == 0) {
+        error("Input vector cannot be empty");
+    }
+    KernelBudget budget;
+    kernel_budget_init(&budget, deadline_sexp);
+    return ScalarReal(bracket_median(window, &window->spread, threads, &budget));
+}
+
+/*
+ * Number of values currently in the window.
+ *
+ * @param ptr Window external pointer
+ * @return Integer scalar
+ */
+SEXP window_size_c(SEXP ptr) {
+    return ScalarInteger(window_get(ptr)->size);
+}